@@ -0,0 +1,414 @@
+#ifndef PAR_PROG_BENCH_H
+#define PAR_PROG_BENCH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "perf_counters.h"
+
+#define BENCH_MAX_SAMPLES 1000
+#define BENCH_MAX_BASELINE 4096
+#define BENCH_NAME_LENGTH 96
+
+
+typedef enum {
+    BENCH_TEXT,
+    BENCH_CSV,
+    BENCH_JSON
+} bench_format;
+
+
+/*
+ * One measured configuration. `run` is timed, `setup` (optional) runs
+ * untimed before every repetition, e.g. to restore the input of a sort.
+ */
+typedef struct {
+    const char* name;
+    const char* distribution;
+    long long size;
+    int threads;
+    int ranks;
+    double bytes;           ///< Bytes streamed per run, 0 if bandwidth is meaningless
+    void (*setup)(void* ctx);
+    void (*run)(void* ctx);
+    void* ctx;
+} bench_kernel;
+
+
+typedef struct {
+    char name[BENCH_NAME_LENGTH];
+    char distribution[BENCH_NAME_LENGTH];
+    long long size;
+    int threads;
+    int ranks;
+    int repetitions;
+    double median;
+    double p5;
+    double p95;
+    double mean;
+    double stddev;
+    double bandwidth;       ///< GB/s at the median, 0 if unknown
+    double baseline;        ///< Baseline median, 0 if there is none
+    int regression;
+    int counted;            ///< Hardware counters were collected
+    double counters[PERF_EVENT_COUNT];     ///< Per repetition, summed over threads and ranks
+    double ipc;
+    double bytes_per_cycle;
+    double llc_mpki;        ///< Misses per thousand instructions
+    double branch_mpki;
+    double dtlb_mpki;
+} bench_result;
+
+
+typedef struct {
+    int warmup;
+    int min_repetitions;
+    int max_repetitions;
+    double max_seconds;     ///< Measurement budget per kernel
+    double target_ci;       ///< Stop once the 95% CI half-width is below this fraction of the mean
+    double threshold;       ///< Relative median slowdown that counts as a regression
+    bench_format format;
+    int report;             ///< Only reporting processes print, e.g. MPI rank 0
+    /* MPI programs agree on each sample (e.g. max over ranks) so every rank takes the same decisions */
+    double (*sync_sample)(double seconds);
+    int counters;           ///< Collect hardware counters around every timed repetition
+    /* MPI programs sum the counters of all ranks in place */
+    void (*sync_counters)(uint64_t* values, int count);
+
+    FILE* output;
+    int header_written;
+    int regressions;
+    int baseline_count;
+    bench_result* baseline;
+} bench_config;
+
+
+static inline double bench_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+
+static inline void bench_config_default(bench_config* cfg) {
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->warmup = 2;
+    cfg->min_repetitions = 5;
+    cfg->max_repetitions = 100;
+    cfg->max_seconds = 20.0;
+    cfg->target_ci = 0.02;
+    cfg->threshold = 0.05;
+    cfg->format = BENCH_TEXT;
+    cfg->report = 1;
+    cfg->output = stdout;
+}
+
+
+static inline void bench_load_baseline(bench_config* cfg, const char* path) {
+    FILE* file = fopen(path, "r");
+    char line[1024];
+    if (file == NULL) {
+        fprintf(stderr, "bench: cannot open baseline %s\n", path);
+        return;
+    }
+
+    cfg->baseline = (bench_result*) calloc(BENCH_MAX_BASELINE, sizeof(bench_result));
+    while (cfg->baseline != NULL && cfg->baseline_count < BENCH_MAX_BASELINE && fgets(line, sizeof(line), file)) {
+        bench_result* entry = &cfg->baseline[cfg->baseline_count];
+        if (strncmp(line, "name,", 5) == 0)
+            continue;
+        if (sscanf(line, "%95[^,],%95[^,],%lld,%d,%d,%d,%lf", entry->name, entry->distribution, &entry->size,
+                   &entry->threads, &entry->ranks, &entry->repetitions, &entry->median) == 7)
+            cfg->baseline_count++;
+    }
+    fclose(file);
+}
+
+
+/*
+ * Environment overrides: BENCH_FORMAT (text|csv|json), BENCH_OUTPUT (file,
+ * appended), BENCH_BASELINE (CSV written by an earlier run), BENCH_THRESHOLD,
+ * BENCH_WARMUP, BENCH_MIN_REPS, BENCH_MAX_REPS, BENCH_MAX_SECONDS, BENCH_CI,
+ * BENCH_PERF=1 for hardware counters.
+ */
+static inline void bench_config_env(bench_config* cfg) {
+    const char* value;
+    if ((value = getenv("BENCH_FORMAT")) != NULL) {
+        if (strcmp(value, "csv") == 0)
+            cfg->format = BENCH_CSV;
+        else if (strcmp(value, "json") == 0)
+            cfg->format = BENCH_JSON;
+        else
+            cfg->format = BENCH_TEXT;
+    }
+    if ((value = getenv("BENCH_WARMUP")) != NULL)
+        cfg->warmup = atoi(value);
+    if ((value = getenv("BENCH_MIN_REPS")) != NULL)
+        cfg->min_repetitions = atoi(value);
+    if ((value = getenv("BENCH_MAX_REPS")) != NULL)
+        cfg->max_repetitions = atoi(value);
+    if ((value = getenv("BENCH_MAX_SECONDS")) != NULL)
+        cfg->max_seconds = atof(value);
+    if ((value = getenv("BENCH_CI")) != NULL)
+        cfg->target_ci = atof(value);
+    if ((value = getenv("BENCH_THRESHOLD")) != NULL)
+        cfg->threshold = atof(value);
+    if ((value = getenv("BENCH_PERF")) != NULL)
+        cfg->counters = atoi(value) != 0;
+
+    if (cfg->min_repetitions < 1)
+        cfg->min_repetitions = 1;
+    if (cfg->max_repetitions > BENCH_MAX_SAMPLES)
+        cfg->max_repetitions = BENCH_MAX_SAMPLES;
+    if (cfg->max_repetitions < cfg->min_repetitions)
+        cfg->max_repetitions = cfg->min_repetitions;
+
+    if (!cfg->report)
+        return;
+    if ((value = getenv("BENCH_BASELINE")) != NULL)
+        bench_load_baseline(cfg, value);
+    if ((value = getenv("BENCH_OUTPUT")) != NULL) {
+        FILE* file = fopen(value, "a");
+        if (file == NULL) {
+            fprintf(stderr, "bench: cannot open %s, writing to stdout\n", value);
+        } else {
+            cfg->output = file;
+            /* Appending to an existing CSV must not repeat its header */
+            fseek(file, 0, SEEK_END);
+            cfg->header_written = ftell(file) > 0;
+        }
+    }
+}
+
+
+static inline int bench_compare_doubles(const void* a, const void* b) {
+    double x = *(const double*) a, y = *(const double*) b;
+    return (x > y) - (x < y);
+}
+
+
+static inline double bench_percentile(const double* sorted, int count, double fraction) {
+    double position = fraction * (count - 1);
+    int lower = (int) position;
+    int upper = lower + 1 < count ? lower + 1 : lower;
+    return sorted[lower] + (position - lower) * (sorted[upper] - sorted[lower]);
+}
+
+
+/* Two-sided 95% Student t quantile, so short runs are not stopped too early */
+static inline double bench_t95(int degrees) {
+    static const double table[] = {12.71, 4.30, 3.18, 2.78, 2.57, 2.45, 2.36, 2.31, 2.26, 2.23,
+                                   2.20, 2.18, 2.16, 2.14, 2.13, 2.12, 2.11, 2.10, 2.09, 2.09};
+    if (degrees < 1)
+        return table[0];
+    return degrees <= 20 ? table[degrees - 1] : 1.96 + 2.5 / degrees;
+}
+
+
+static inline void bench_summarize(const double* samples, int count, bench_result* result) {
+    double sorted[BENCH_MAX_SAMPLES];
+    double sum = 0.0, squares = 0.0;
+    memcpy(sorted, samples, count * sizeof(double));
+    qsort(sorted, count, sizeof(double), bench_compare_doubles);
+
+    for (int i = 0; i < count; i++)
+        sum += samples[i];
+    result->mean = sum / count;
+    for (int i = 0; i < count; i++)
+        squares += (samples[i] - result->mean) * (samples[i] - result->mean);
+
+    result->repetitions = count;
+    result->stddev = count > 1 ? sqrt(squares / (count - 1)) : 0.0;
+    result->median = bench_percentile(sorted, count, 0.5);
+    result->p5 = bench_percentile(sorted, count, 0.05);
+    result->p95 = bench_percentile(sorted, count, 0.95);
+}
+
+
+static inline double bench_sample(bench_config* cfg, const bench_kernel* kernel, perf_region* region) {
+    if (kernel->setup != NULL)
+        kernel->setup(kernel->ctx);
+    if (region != NULL)
+        perf_region_begin(region);
+    double start = bench_now();
+    kernel->run(kernel->ctx);
+    double seconds = bench_now() - start;
+    if (region != NULL)
+        perf_region_end(region);
+    return cfg->sync_sample != NULL ? cfg->sync_sample(seconds) : seconds;
+}
+
+
+static inline void bench_compare(bench_config* cfg, bench_result* result) {
+    for (int i = 0; i < cfg->baseline_count; i++) {
+        const bench_result* entry = &cfg->baseline[i];
+        if (strcmp(entry->name, result->name) == 0 && strcmp(entry->distribution, result->distribution) == 0 &&
+            entry->size == result->size && entry->threads == result->threads && entry->ranks == result->ranks) {
+            result->baseline = entry->median;
+            result->regression = result->median > entry->median * (1.0 + cfg->threshold);
+            cfg->regressions += result->regression;
+            return;
+        }
+    }
+}
+
+
+static inline void bench_derive_counters(bench_config* cfg, const bench_kernel* kernel, perf_region* region,
+                                         bench_result* result) {
+    uint64_t values[PERF_EVENT_COUNT] = {0};
+    if (region != NULL)
+        memcpy(values, region->values, sizeof(values));
+    if (cfg->sync_counters != NULL)
+        cfg->sync_counters(values, PERF_EVENT_COUNT);
+
+    result->counted = values[PERF_CYCLES] > 0;
+    for (int e = 0; e < PERF_EVENT_COUNT; e++)
+        result->counters[e] = (double) values[e] / result->repetitions;
+
+    double cycles = result->counters[PERF_CYCLES];
+    double kilo_instructions = result->counters[PERF_INSTRUCTIONS] / 1000.0;
+    if (cycles > 0.0) {
+        result->ipc = result->counters[PERF_INSTRUCTIONS] / cycles;
+        result->bytes_per_cycle = kernel->bytes / cycles;
+    }
+    if (kilo_instructions > 0.0) {
+        result->llc_mpki = result->counters[PERF_LLC_MISSES] / kilo_instructions;
+        result->branch_mpki = result->counters[PERF_BRANCH_MISSES] / kilo_instructions;
+        result->dtlb_mpki = result->counters[PERF_DTLB_MISSES] / kilo_instructions;
+    }
+}
+
+
+static inline void bench_report(bench_config* cfg, const bench_result* result) {
+    FILE* out = cfg->output;
+    if (!cfg->report)
+        return;
+
+    if (cfg->format == BENCH_CSV) {
+        if (!cfg->header_written)
+            fprintf(out, "name,distribution,size,threads,ranks,repetitions,median,p5,p95,mean,stddev,gbs,baseline,"
+                         "regression,cycles,instructions,llc_misses,branch_misses,dtlb_misses,ipc,bytes_per_cycle,"
+                         "llc_mpki,branch_mpki,dtlb_mpki\n");
+        cfg->header_written = 1;
+        fprintf(out, "%s,%s,%lld,%d,%d,%d,%.9f,%.9f,%.9f,%.9f,%.9f,%.3f,%.9f,%d,%.0f,%.0f,%.0f,%.0f,%.0f,%.3f,%.3f,"
+                     "%.3f,%.3f,%.3f\n", result->name,
+                result->distribution, result->size, result->threads, result->ranks, result->repetitions,
+                result->median, result->p5, result->p95, result->mean, result->stddev, result->bandwidth,
+                result->baseline, result->regression, result->counters[PERF_CYCLES],
+                result->counters[PERF_INSTRUCTIONS], result->counters[PERF_LLC_MISSES],
+                result->counters[PERF_BRANCH_MISSES], result->counters[PERF_DTLB_MISSES], result->ipc,
+                result->bytes_per_cycle, result->llc_mpki, result->branch_mpki, result->dtlb_mpki);
+    } else if (cfg->format == BENCH_JSON) {
+        /* JSON Lines: one object per measured configuration */
+        fprintf(out, "{\"name\": \"%s\", \"distribution\": \"%s\", \"size\": %lld, \"threads\": %d, \"ranks\": %d, "
+                     "\"repetitions\": %d, \"median\": %.9f, \"p5\": %.9f, \"p95\": %.9f, \"mean\": %.9f, "
+                     "\"stddev\": %.9f, \"gbs\": %.3f, \"baseline\": %.9f, \"regression\": %s",
+                result->name, result->distribution, result->size, result->threads, result->ranks,
+                result->repetitions, result->median, result->p5, result->p95, result->mean, result->stddev,
+                result->bandwidth, result->baseline, result->regression ? "true" : "false");
+        if (result->counted) {
+            fprintf(out, ", \"counters\": {");
+            for (int e = 0; e < PERF_EVENT_COUNT; e++)
+                fprintf(out, "\"%s\": %.0f, ", perf_event_name((perf_event_kind) e), result->counters[e]);
+            fprintf(out, "\"ipc\": %.3f, \"bytes_per_cycle\": %.3f, \"llc_mpki\": %.3f, \"branch_mpki\": %.3f, "
+                         "\"dtlb_mpki\": %.3f}", result->ipc, result->bytes_per_cycle, result->llc_mpki,
+                    result->branch_mpki, result->dtlb_mpki);
+        }
+        fprintf(out, "}\n");
+    } else {
+        fprintf(out, "%-28s %-16s n=%-11lld thr=%-3d ranks=%-3d median=%.6f p5=%.6f p95=%.6f sd=%.6f reps=%d",
+                result->name, result->distribution, result->size, result->threads, result->ranks,
+                result->median, result->p5, result->p95, result->stddev, result->repetitions);
+        if (result->bandwidth > 0.0)
+            fprintf(out, " %.2f GB/s", result->bandwidth);
+        if (result->baseline > 0.0)
+            fprintf(out, " (baseline %.6f%s)", result->baseline, result->regression ? ", REGRESSION" : "");
+        fprintf(out, "\n");
+        if (result->counted)
+            fprintf(out, "%-28s ipc=%.2f bytes/cycle=%.2f llc_mpki=%.2f branch_mpki=%.2f dtlb_mpki=%.2f\n", "",
+                    result->ipc, result->bytes_per_cycle, result->llc_mpki, result->branch_mpki, result->dtlb_mpki);
+    }
+    fflush(out);
+}
+
+
+/*
+ * Warm up, then repeat until the confidence interval is tight, the
+ * repetition cap is hit or the time budget is spent. Decisions only use
+ * the (synchronized) samples, so MPI ranks stay in lockstep.
+ */
+static inline void bench_run(bench_config* cfg, const bench_kernel* kernel, bench_result* result) {
+    double samples[BENCH_MAX_SAMPLES];
+    double spent = 0.0;
+    int count = 0;
+    perf_region region;
+    perf_region* counted = NULL;
+
+    memset(result, 0, sizeof(*result));
+    snprintf(result->name, sizeof(result->name), "%s", kernel->name);
+    snprintf(result->distribution, sizeof(result->distribution), "%s",
+             kernel->distribution != NULL ? kernel->distribution : "none");
+    result->size = kernel->size;
+    result->threads = kernel->threads;
+    result->ranks = kernel->ranks;
+
+    for (int i = 0; i < cfg->warmup; i++)
+        bench_sample(cfg, kernel, NULL);
+
+    /* Counting only the timed repetitions keeps warmup effects out of the derived metrics */
+    if (cfg->counters) {
+        if (perf_region_open(&region, kernel->threads) == 0)
+            counted = &region;
+        else if (cfg->report)
+            fprintf(stderr, "bench: hardware counters are unavailable for %s\n", kernel->name);
+    }
+
+    while (count < cfg->max_repetitions) {
+        samples[count] = bench_sample(cfg, kernel, counted);
+        spent += samples[count];
+        count++;
+
+        if (count < cfg->min_repetitions)
+            continue;
+        if (spent >= cfg->max_seconds)
+            break;
+
+        double sum = 0.0, squares = 0.0;
+        for (int i = 0; i < count; i++)
+            sum += samples[i];
+        double mean = sum / count;
+        for (int i = 0; i < count; i++)
+            squares += (samples[i] - mean) * (samples[i] - mean);
+        double half_width = count > 1 ? bench_t95(count - 1) * sqrt(squares / (count - 1) / count) : 0.0;
+        if (half_width <= cfg->target_ci * mean)
+            break;
+    }
+
+    bench_summarize(samples, count, result);
+    if (kernel->bytes > 0.0 && result->median > 0.0)
+        result->bandwidth = kernel->bytes / result->median / 1e9;
+    /* Every rank takes part in the counter sum, also when its own counters failed to open */
+    if (cfg->counters)
+        bench_derive_counters(cfg, kernel, counted, result);
+    if (counted != NULL)
+        perf_region_close(counted);
+    bench_compare(cfg, result);
+    bench_report(cfg, result);
+}
+
+
+/* Close the output and return the number of regressions against the baseline */
+static inline int bench_finish(bench_config* cfg) {
+    if (cfg->report && cfg->baseline_count > 0)
+        fprintf(stderr, "bench: %d regression(s) against the baseline\n", cfg->regressions);
+    if (cfg->output != NULL && cfg->output != stdout)
+        fclose(cfg->output);
+    cfg->output = NULL;
+    free(cfg->baseline);
+    cfg->baseline = NULL;
+    return cfg->regressions;
+}
+
+#endif
@@ -0,0 +1,173 @@
+#ifndef PAR_PROG_DATASET_CACHE_H
+#define PAR_PROG_DATASET_CACHE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "random_data.h"
+
+#ifndef MAP_POPULATE
+#define MAP_POPULATE 0
+#endif
+
+#define DATASET_CACHE_DIR_ENV "DATASET_CACHE_DIR"
+#define DATASET_CACHE_DEFAULT_DIR "/tmp/par_prog_datasets"
+#define DATASET_COPY_BLOCK (1 << 16)
+#define DATASET_PATH_LENGTH 4096
+
+
+/*
+ * A benchmark input keyed by (distribution, length, seed). The array is
+ * generated once into <cache dir>/<distribution>_<length>_<seed>.bin and
+ * every later open maps that file instead of regenerating it.
+ */
+typedef struct {
+    int* data;
+    long long length;
+    data_distribution dist;
+    uint64_t seed;
+    size_t mapped_bytes;    ///< 0 when the cache was unusable and data lives on the heap
+} dataset;
+
+
+static inline const char* dataset_cache_dir(void) {
+    const char* dir = getenv(DATASET_CACHE_DIR_ENV);
+    return dir != NULL && dir[0] != '\0' ? dir : DATASET_CACHE_DEFAULT_DIR;
+}
+
+
+static inline void dataset_path(char* path, size_t size, data_distribution dist, long long length, uint64_t seed) {
+    snprintf(path, size, "%s/%s_%lld_%llu.bin", dataset_cache_dir(), data_distribution_name(dist),
+             length, (unsigned long long) seed);
+}
+
+
+static inline int dataset_write_file(const char* path, data_distribution dist, long long length, uint64_t seed) {
+    char tmp_path[DATASET_PATH_LENGTH + 32];
+    size_t bytes = (size_t) length * sizeof(int);
+    int* buffer = (int*) malloc(bytes > 0 ? bytes : 1);
+    if (buffer == NULL)
+        return -1;
+    generate_data(buffer, length, dist, seed);
+
+    /* Write under a private name and rename, so concurrent runs never map a half-written file */
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp.%ld", path, (long) getpid());
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        free(buffer);
+        return -1;
+    }
+
+    const char* cursor = (const char*) buffer;
+    size_t left = bytes;
+    while (left > 0) {
+        ssize_t written = write(fd, cursor, left);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0) {
+            close(fd);
+            unlink(tmp_path);
+            free(buffer);
+            return -1;
+        }
+        cursor += written;
+        left -= (size_t) written;
+    }
+    free(buffer);
+
+    if (close(fd) != 0 || rename(tmp_path, path) != 0) {
+        unlink(tmp_path);
+        return -1;
+    }
+    return 0;
+}
+
+
+static inline int dataset_map_file(dataset* ds, const char* path, int writable) {
+    size_t bytes = (size_t) ds->length * sizeof(int);
+    struct stat info;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+    if (fstat(fd, &info) != 0 || (size_t) info.st_size != bytes || bytes == 0) {
+        close(fd);
+        return -1;
+    }
+
+    /* A private writable mapping is copy-on-write: the file is never modified */
+    int protection = PROT_READ | (writable ? PROT_WRITE : 0);
+    void* data = mmap(NULL, bytes, protection, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return -1;
+
+#ifdef MADV_HUGEPAGE
+    madvise(data, bytes, MADV_HUGEPAGE);
+#endif
+#ifdef MADV_WILLNEED
+    madvise(data, bytes, MADV_WILLNEED);
+#endif
+
+    ds->data = (int*) data;
+    ds->mapped_bytes = bytes;
+    return 0;
+}
+
+
+/*
+ * Open the dataset, generating its cache file on first use. `writable`
+ * gives a copy-on-write view for callers that patch a few elements (e.g.
+ * search sentinels). Falls back to a heap array if the cache is unusable.
+ */
+static inline int dataset_open(dataset* ds, data_distribution dist, long long length, uint64_t seed, int writable) {
+    char path[DATASET_PATH_LENGTH];
+    ds->data = NULL;
+    ds->length = length;
+    ds->dist = dist;
+    ds->seed = seed;
+    ds->mapped_bytes = 0;
+
+    dataset_path(path, sizeof(path), dist, length, seed);
+    if (dataset_map_file(ds, path, writable) == 0)
+        return 0;
+
+    mkdir(dataset_cache_dir(), 0755);
+    if (dataset_write_file(path, dist, length, seed) == 0 && dataset_map_file(ds, path, writable) == 0)
+        return 0;
+
+    fprintf(stderr, "dataset cache: cannot use %s, generating in memory\n", path);
+    ds->data = (int*) malloc((size_t) length * sizeof(int));
+    if (ds->data == NULL)
+        return -1;
+    generate_data(ds->data, length, dist, seed);
+    return 0;
+}
+
+
+static inline void dataset_close(dataset* ds) {
+    if (ds->mapped_bytes > 0)
+        munmap(ds->data, ds->mapped_bytes);
+    else
+        free(ds->data);
+    ds->data = NULL;
+    ds->mapped_bytes = 0;
+}
+
+
+/* Refresh a working buffer for kernels that modify their input, e.g. sorts */
+static inline void dataset_copy(const dataset* ds, int* destination) {
+    long long blocks = (ds->length + DATASET_COPY_BLOCK - 1) / DATASET_COPY_BLOCK;
+    #pragma omp parallel for schedule(static)
+    for (long long block = 0; block < blocks; block++) {
+        long long begin = block * DATASET_COPY_BLOCK;
+        long long end = begin + DATASET_COPY_BLOCK < ds->length ? begin + DATASET_COPY_BLOCK : ds->length;
+        memcpy(destination + begin, ds->data + begin, (size_t) (end - begin) * sizeof(int));
+    }
+}
+
+#endif
@@ -0,0 +1,119 @@
+#ifndef PAR_PROG_LOCKS_H
+#define PAR_PROG_LOCKS_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <sched.h>
+
+#define LOCK_CACHE_LINE 64
+#define LOCK_SPIN_LIMIT 1024
+
+
+/* Spin politely, and give the core away now and then in case the holder was preempted */
+static inline void lock_backoff(int* spins) {
+    if (++*spins >= LOCK_SPIN_LIMIT) {
+        *spins = 0;
+        sched_yield();
+        return;
+    }
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+
+/* Test-and-test-and-set: waiters spin on a shared read and only write when the lock looks free */
+typedef struct {
+    _Alignas(LOCK_CACHE_LINE) atomic_int locked;
+} ttas_lock;
+
+static inline void ttas_init(ttas_lock* lock) {
+    atomic_init(&lock->locked, 0);
+}
+
+static inline void ttas_acquire(ttas_lock* lock) {
+    int spins = 0;
+    for (;;) {
+        while (atomic_load_explicit(&lock->locked, memory_order_relaxed))
+            lock_backoff(&spins);
+        if (!atomic_exchange_explicit(&lock->locked, 1, memory_order_acquire))
+            return;
+    }
+}
+
+static inline void ttas_release(ttas_lock* lock) {
+    atomic_store_explicit(&lock->locked, 0, memory_order_release);
+}
+
+
+/* FIFO ticket lock; the two counters live on separate lines so taking a ticket does not disturb the holder */
+typedef struct {
+    _Alignas(LOCK_CACHE_LINE) atomic_uint next;
+    _Alignas(LOCK_CACHE_LINE) atomic_uint serving;
+} ticket_lock;
+
+static inline void ticket_init(ticket_lock* lock) {
+    atomic_init(&lock->next, 0);
+    atomic_init(&lock->serving, 0);
+}
+
+static inline void ticket_acquire(ticket_lock* lock) {
+    unsigned ticket = atomic_fetch_add_explicit(&lock->next, 1, memory_order_relaxed);
+    int spins = 0;
+    while (atomic_load_explicit(&lock->serving, memory_order_acquire) != ticket)
+        lock_backoff(&spins);
+}
+
+static inline void ticket_release(ticket_lock* lock) {
+    unsigned serving = atomic_load_explicit(&lock->serving, memory_order_relaxed);
+    atomic_store_explicit(&lock->serving, serving + 1, memory_order_release);
+}
+
+
+/*
+ * MCS queue lock: every waiter spins on the flag of its own node, and the
+ * holder hands the lock to its successor directly. The node must stay
+ * alive from acquire to release, a local variable of the caller will do.
+ */
+typedef struct mcs_node {
+    _Alignas(LOCK_CACHE_LINE) _Atomic(struct mcs_node*) next;
+    atomic_int locked;
+} mcs_node;
+
+typedef struct {
+    _Alignas(LOCK_CACHE_LINE) _Atomic(mcs_node*) tail;
+} mcs_lock;
+
+static inline void mcs_init(mcs_lock* lock) {
+    atomic_init(&lock->tail, NULL);
+}
+
+static inline void mcs_acquire(mcs_lock* lock, mcs_node* node) {
+    atomic_store_explicit(&node->next, NULL, memory_order_relaxed);
+    atomic_store_explicit(&node->locked, 1, memory_order_relaxed);
+    mcs_node* previous = atomic_exchange_explicit(&lock->tail, node, memory_order_acq_rel);
+    if (previous == NULL)
+        return;
+
+    atomic_store_explicit(&previous->next, node, memory_order_release);
+    int spins = 0;
+    while (atomic_load_explicit(&node->locked, memory_order_acquire))
+        lock_backoff(&spins);
+}
+
+static inline void mcs_release(mcs_lock* lock, mcs_node* node) {
+    mcs_node* next = atomic_load_explicit(&node->next, memory_order_acquire);
+    if (next == NULL) {
+        mcs_node* expected = node;
+        if (atomic_compare_exchange_strong_explicit(&lock->tail, &expected, NULL, memory_order_release,
+                                                    memory_order_relaxed))
+            return;
+        /* A successor swapped itself in but has not linked yet */
+        int spins = 0;
+        while ((next = atomic_load_explicit(&node->next, memory_order_acquire)) == NULL)
+            lock_backoff(&spins);
+    }
+    atomic_store_explicit(&next->locked, 0, memory_order_release);
+}
+
+#endif
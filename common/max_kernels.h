@@ -0,0 +1,146 @@
+#ifndef PAR_PROG_MAX_KERNELS_H
+#define PAR_PROG_MAX_KERNELS_H
+
+#include <limits.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MAX_KERNELS_X86 1
+#endif
+
+
+typedef int (*max_kernel_t)(const int* array, int n);
+
+typedef struct {
+    const char* name;
+    max_kernel_t kernel;
+    int (*supported)(void);
+} max_kernel_info;
+
+
+/* Four independent accumulators break the loop-carried dependency on a single max */
+static inline int max_kernel_scalar(const int* array, int n) {
+    int m0 = INT_MIN, m1 = INT_MIN, m2 = INT_MIN, m3 = INT_MIN;
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        m0 = array[i] > m0 ? array[i] : m0;
+        m1 = array[i + 1] > m1 ? array[i + 1] : m1;
+        m2 = array[i + 2] > m2 ? array[i + 2] : m2;
+        m3 = array[i + 3] > m3 ? array[i + 3] : m3;
+    }
+    for (; i < n; i++)
+        m0 = array[i] > m0 ? array[i] : m0;
+
+    m0 = m0 > m1 ? m0 : m1;
+    m2 = m2 > m3 ? m2 : m3;
+    return m0 > m2 ? m0 : m2;
+}
+
+
+static inline int scalar_supported(void) {
+    return 1;
+}
+
+
+#ifdef MAX_KERNELS_X86
+__attribute__((target("sse4.1")))
+static inline int max_kernel_sse41(const int* array, int n) {
+    __m128i m0 = _mm_set1_epi32(INT_MIN), m1 = m0, m2 = m0, m3 = m0;
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        m0 = _mm_max_epi32(m0, _mm_loadu_si128((const __m128i*) (array + i)));
+        m1 = _mm_max_epi32(m1, _mm_loadu_si128((const __m128i*) (array + i + 4)));
+        m2 = _mm_max_epi32(m2, _mm_loadu_si128((const __m128i*) (array + i + 8)));
+        m3 = _mm_max_epi32(m3, _mm_loadu_si128((const __m128i*) (array + i + 12)));
+    }
+    m0 = _mm_max_epi32(_mm_max_epi32(m0, m1), _mm_max_epi32(m2, m3));
+    m0 = _mm_max_epi32(m0, _mm_shuffle_epi32(m0, _MM_SHUFFLE(1, 0, 3, 2)));
+    m0 = _mm_max_epi32(m0, _mm_shuffle_epi32(m0, _MM_SHUFFLE(2, 3, 0, 1)));
+
+    int max = _mm_cvtsi128_si32(m0);
+    for (; i < n; i++)
+        max = array[i] > max ? array[i] : max;
+    return max;
+}
+
+
+__attribute__((target("avx2")))
+static inline int max_kernel_avx2(const int* array, int n) {
+    __m256i m0 = _mm256_set1_epi32(INT_MIN), m1 = m0, m2 = m0, m3 = m0;
+    int i = 0;
+    for (; i + 32 <= n; i += 32) {
+        m0 = _mm256_max_epi32(m0, _mm256_loadu_si256((const __m256i*) (array + i)));
+        m1 = _mm256_max_epi32(m1, _mm256_loadu_si256((const __m256i*) (array + i + 8)));
+        m2 = _mm256_max_epi32(m2, _mm256_loadu_si256((const __m256i*) (array + i + 16)));
+        m3 = _mm256_max_epi32(m3, _mm256_loadu_si256((const __m256i*) (array + i + 24)));
+    }
+    m0 = _mm256_max_epi32(_mm256_max_epi32(m0, m1), _mm256_max_epi32(m2, m3));
+    __m128i m = _mm_max_epi32(_mm256_castsi256_si128(m0), _mm256_extracti128_si256(m0, 1));
+    m = _mm_max_epi32(m, _mm_shuffle_epi32(m, _MM_SHUFFLE(1, 0, 3, 2)));
+    m = _mm_max_epi32(m, _mm_shuffle_epi32(m, _MM_SHUFFLE(2, 3, 0, 1)));
+
+    int max = _mm_cvtsi128_si32(m);
+    for (; i < n; i++)
+        max = array[i] > max ? array[i] : max;
+    return max;
+}
+
+
+__attribute__((target("avx512f")))
+static inline int max_kernel_avx512(const int* array, int n) {
+    __m512i m0 = _mm512_set1_epi32(INT_MIN), m1 = m0, m2 = m0, m3 = m0;
+    int i = 0;
+    for (; i + 64 <= n; i += 64) {
+        m0 = _mm512_max_epi32(m0, _mm512_loadu_si512((const void*) (array + i)));
+        m1 = _mm512_max_epi32(m1, _mm512_loadu_si512((const void*) (array + i + 16)));
+        m2 = _mm512_max_epi32(m2, _mm512_loadu_si512((const void*) (array + i + 32)));
+        m3 = _mm512_max_epi32(m3, _mm512_loadu_si512((const void*) (array + i + 48)));
+    }
+    m0 = _mm512_max_epi32(_mm512_max_epi32(m0, m1), _mm512_max_epi32(m2, m3));
+
+    int max = _mm512_reduce_max_epi32(m0);
+    for (; i < n; i++)
+        max = array[i] > max ? array[i] : max;
+    return max;
+}
+
+
+static inline int sse41_supported(void) {
+    return __builtin_cpu_supports("sse4.1");
+}
+
+
+static inline int avx2_supported(void) {
+    return __builtin_cpu_supports("avx2");
+}
+
+
+static inline int avx512_supported(void) {
+    return __builtin_cpu_supports("avx512f");
+}
+#endif
+
+
+/* Ordered from the widest to the narrowest ISA, so the first supported entry is the best one */
+static const max_kernel_info max_kernels[] = {
+#ifdef MAX_KERNELS_X86
+    {"AVX-512", max_kernel_avx512, avx512_supported},
+    {"AVX2", max_kernel_avx2, avx2_supported},
+    {"SSE4.1", max_kernel_sse41, sse41_supported},
+#endif
+    {"SCALAR", max_kernel_scalar, scalar_supported},
+};
+static const int max_kernels_count = sizeof(max_kernels) / sizeof(max_kernels[0]);
+
+
+static inline const max_kernel_info* select_max_kernel(void) {
+#ifdef MAX_KERNELS_X86
+    __builtin_cpu_init();
+#endif
+    for (int i = 0; i < max_kernels_count; i++)
+        if (max_kernels[i].supported())
+            return &max_kernels[i];
+    return &max_kernels[max_kernels_count - 1];
+}
+
+#endif
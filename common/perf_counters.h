@@ -0,0 +1,174 @@
+#ifndef PAR_PROG_PERF_COUNTERS_H
+#define PAR_PROG_PERF_COUNTERS_H
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#define PERF_MAX_THREADS 256
+
+
+typedef enum {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_LLC_MISSES,
+    PERF_BRANCH_MISSES,
+    PERF_DTLB_MISSES,
+    PERF_EVENT_COUNT
+} perf_event_kind;
+
+
+/*
+ * Hardware counters for every OpenMP thread of a timed region. The counters
+ * are opened per thread id, so only the threads that run the region are
+ * counted; events the PMU (or a VM) does not expose read as zero.
+ */
+typedef struct {
+    int threads;
+    int available;
+    int fds[PERF_MAX_THREADS][PERF_EVENT_COUNT];
+    uint64_t values[PERF_EVENT_COUNT];     ///< Summed over threads and all measured intervals
+} perf_region;
+
+
+static inline const char* perf_event_name(perf_event_kind kind) {
+    static const char* names[] = {"cycles", "instructions", "llc_misses", "branch_misses", "dtlb_misses"};
+    return kind < PERF_EVENT_COUNT ? names[kind] : "unknown";
+}
+
+
+#ifdef __linux__
+static inline void perf_event_attr_for(perf_event_kind kind, struct perf_event_attr* attr) {
+    memset(attr, 0, sizeof(*attr));
+    attr->size = sizeof(*attr);
+    attr->disabled = 1;
+    attr->exclude_kernel = 1;
+    attr->exclude_hv = 1;
+    attr->read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    switch (kind) {
+        case PERF_CYCLES:
+            attr->type = PERF_TYPE_HARDWARE;
+            attr->config = PERF_COUNT_HW_CPU_CYCLES;
+            break;
+        case PERF_INSTRUCTIONS:
+            attr->type = PERF_TYPE_HARDWARE;
+            attr->config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+        case PERF_LLC_MISSES:
+            attr->type = PERF_TYPE_HW_CACHE;
+            attr->config = PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                           (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            break;
+        case PERF_BRANCH_MISSES:
+            attr->type = PERF_TYPE_HARDWARE;
+            attr->config = PERF_COUNT_HW_BRANCH_MISSES;
+            break;
+        case PERF_DTLB_MISSES:
+        default:
+            attr->type = PERF_TYPE_HW_CACHE;
+            attr->config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                           (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            break;
+    }
+}
+#endif
+
+
+/* Open the counters for the threads of a `threads`-wide OpenMP team */
+static inline int perf_region_open(perf_region* region, int threads) {
+    memset(region, 0, sizeof(*region));
+    region->threads = threads < 1 ? 1 : (threads > PERF_MAX_THREADS ? PERF_MAX_THREADS : threads);
+    for (int t = 0; t < PERF_MAX_THREADS; t++)
+        for (int e = 0; e < PERF_EVENT_COUNT; e++)
+            region->fds[t][e] = -1;
+
+#ifdef __linux__
+    pid_t tids[PERF_MAX_THREADS];
+    int team = region->threads;
+    for (int t = 0; t < team; t++)
+        tids[t] = 0;
+
+    /* The runtime reuses its thread pool, so these are the threads that will run the region */
+    #pragma omp parallel num_threads(team)
+    {
+#ifdef _OPENMP
+        int thread = omp_get_thread_num();
+#else
+        int thread = 0;
+#endif
+        if (thread < PERF_MAX_THREADS)
+            tids[thread] = (pid_t) syscall(SYS_gettid);
+    }
+
+    for (int t = 0; t < team; t++) {
+        if (tids[t] == 0)
+            continue;
+        for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+            struct perf_event_attr attr;
+            perf_event_attr_for((perf_event_kind) e, &attr);
+            region->fds[t][e] = (int) syscall(SYS_perf_event_open, &attr, tids[t], -1, -1, 0);
+            if (region->fds[t][e] >= 0)
+                region->available = 1;
+        }
+    }
+#endif
+    return region->available ? 0 : -1;
+}
+
+
+static inline void perf_region_begin(perf_region* region) {
+#ifdef __linux__
+    for (int t = 0; t < region->threads; t++)
+        for (int e = 0; e < PERF_EVENT_COUNT; e++)
+            if (region->fds[t][e] >= 0) {
+                ioctl(region->fds[t][e], PERF_EVENT_IOC_RESET, 0);
+                ioctl(region->fds[t][e], PERF_EVENT_IOC_ENABLE, 0);
+            }
+#endif
+}
+
+
+/* Stop counting and add the interval, scaled for multiplexing, to the totals */
+static inline void perf_region_end(perf_region* region) {
+#ifdef __linux__
+    for (int t = 0; t < region->threads; t++)
+        for (int e = 0; e < PERF_EVENT_COUNT; e++)
+            if (region->fds[t][e] >= 0)
+                ioctl(region->fds[t][e], PERF_EVENT_IOC_DISABLE, 0);
+
+    for (int t = 0; t < region->threads; t++)
+        for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+            uint64_t data[3];
+            if (region->fds[t][e] < 0 || read(region->fds[t][e], data, sizeof(data)) != sizeof(data))
+                continue;
+            if (data[2] > 0 && data[2] < data[1])
+                data[0] = (uint64_t) ((double) data[0] * data[1] / data[2]);
+            region->values[e] += data[0];
+        }
+#endif
+}
+
+
+static inline void perf_region_close(perf_region* region) {
+#ifdef __linux__
+    for (int t = 0; t < region->threads; t++)
+        for (int e = 0; e < PERF_EVENT_COUNT; e++)
+            if (region->fds[t][e] >= 0)
+                close(region->fds[t][e]);
+#endif
+    region->available = 0;
+}
+
+#endif
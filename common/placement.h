@@ -0,0 +1,311 @@
+#ifndef PAR_PROG_PLACEMENT_H
+#define PAR_PROG_PLACEMENT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <omp.h>
+#include "bench.h"
+#include "dataset_cache.h"
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+#define PLACEMENT_REEXEC_ENV "PLACEMENT_REEXEC"
+#define PLACEMENT_MAX_NODES 64
+#define PLACEMENT_MAX_CPUS 1024
+#define PLACEMENT_MASK_WORDS (PLACEMENT_MAX_CPUS / 64)
+#define PLACEMENT_PAGE_SAMPLES 4096
+#define PLACEMENT_PAGE 4096
+
+
+/* CPUs of every NUMA node, from /sys/devices/system/node; a single node with all CPUs elsewhere */
+typedef struct {
+    int nodes;
+    int cpu_count[PLACEMENT_MAX_NODES];
+    unsigned long long cpus[PLACEMENT_MAX_NODES][PLACEMENT_MASK_WORDS];
+} placement_topology;
+
+
+static inline int placement_env_differs(const char* name, const char* value) {
+    const char* current = getenv(name);
+    return value != NULL && (current == NULL || strcmp(current, value) != 0);
+}
+
+
+/*
+ * Take --bind=<close|spread|master|true|false> and --places=<threads|cores|
+ * sockets|explicit list> out of argv. The OpenMP runtime reads
+ * OMP_PROC_BIND and OMP_PLACES once at startup, so when they have to change
+ * the program re-executes itself with the new environment. Call it first
+ * thing in main, and before MPI_Init in MPI programs.
+ */
+static inline void placement_configure(int* argc, char** argv) {
+    const char* bind = NULL;
+    const char* places = NULL;
+    char** original = (char**) malloc((*argc + 1) * sizeof(char*));
+    int kept = 1;
+
+    for (int a = 0; a < *argc; a++)
+        original[a] = argv[a];
+    original[*argc] = NULL;
+
+    for (int a = 1; a < *argc; a++) {
+        if (strncmp(argv[a], "--bind=", 7) == 0)
+            bind = argv[a] + 7;
+        else if (strncmp(argv[a], "--places=", 9) == 0)
+            places = argv[a] + 9;
+        else
+            argv[kept++] = argv[a];
+    }
+    argv[kept] = NULL;
+    *argc = kept;
+
+#ifdef __linux__
+    if ((placement_env_differs("OMP_PROC_BIND", bind) || placement_env_differs("OMP_PLACES", places)) &&
+        getenv(PLACEMENT_REEXEC_ENV) == NULL) {
+        if (bind != NULL)
+            setenv("OMP_PROC_BIND", bind, 1);
+        if (places != NULL)
+            setenv("OMP_PLACES", places, 1);
+        setenv(PLACEMENT_REEXEC_ENV, "1", 1);
+        fflush(stdout);
+        execv("/proc/self/exe", original);
+        perror("placement: re-exec failed, keeping the current binding");
+    }
+#else
+    if (bind != NULL || places != NULL)
+        fprintf(stderr, "placement: set OMP_PROC_BIND/OMP_PLACES in the environment on this platform\n");
+#endif
+    free(original);
+}
+
+
+static inline const char* placement_bind_name(omp_proc_bind_t bind) {
+    switch (bind) {
+        case omp_proc_bind_false:
+            return "false";
+        case omp_proc_bind_true:
+            return "true";
+        case omp_proc_bind_master:
+            return "master";
+        case omp_proc_bind_close:
+            return "close";
+        case omp_proc_bind_spread:
+            return "spread";
+        default:
+            return "unknown";
+    }
+}
+
+
+/* The binding in effect and the place every thread of a full team lands on */
+static inline void placement_report(void) {
+    int threads = omp_get_max_threads();
+    int* thread_places = (int*) malloc(threads * sizeof(int));
+    #pragma omp parallel num_threads(threads)
+    thread_places[omp_get_thread_num()] = omp_get_place_num();
+
+    printf("proc_bind: %s, places: %d (%s)\n", placement_bind_name(omp_get_proc_bind()), omp_get_num_places(),
+           getenv("OMP_PLACES") != NULL ? getenv("OMP_PLACES") : "default");
+    if (omp_get_num_places() > 0) {
+        printf("thread places:");
+        for (int t = 0; t < threads; t++)
+            printf(" %d", thread_places[t]);
+        printf("\n");
+    }
+    free(thread_places);
+}
+
+
+static inline int placement_parse_cpulist(const char* list, unsigned long long* mask) {
+    int count = 0;
+    memset(mask, 0, PLACEMENT_MASK_WORDS * sizeof(unsigned long long));
+    while (*list != '\0' && *list != '\n') {
+        char* end;
+        long first = strtol(list, &end, 10);
+        long last = first;
+        if (end == list)
+            break;
+        if (*end == '-')
+            last = strtol(end + 1, &end, 10);
+        for (long cpu = first; cpu <= last && cpu < PLACEMENT_MAX_CPUS; cpu++) {
+            mask[cpu / 64] |= 1ULL << (cpu % 64);
+            count++;
+        }
+        list = *end == ',' ? end + 1 : end;
+    }
+    return count;
+}
+
+
+static inline void placement_topology_read(placement_topology* topology) {
+    memset(topology, 0, sizeof(*topology));
+#ifdef __linux__
+    for (int node = 0; node < PLACEMENT_MAX_NODES; node++) {
+        char path[128], list[4096];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+        FILE* file = fopen(path, "r");
+        if (file == NULL)
+            break;
+        if (fgets(list, sizeof(list), file) != NULL)
+            topology->cpu_count[node] = placement_parse_cpulist(list, topology->cpus[node]);
+        fclose(file);
+        topology->nodes = node + 1;
+    }
+    if (topology->nodes > 0)
+        return;
+
+    topology->nodes = 1;
+    if (syscall(SYS_sched_getaffinity, 0, sizeof(topology->cpus[0]), topology->cpus[0]) > 0)
+        for (int cpu = 0; cpu < PLACEMENT_MAX_CPUS; cpu++)
+            topology->cpu_count[0] += (topology->cpus[0][cpu / 64] >> (cpu % 64)) & 1;
+#else
+    topology->nodes = 1;
+    topology->cpu_count[0] = omp_get_num_procs();
+#endif
+}
+
+
+/*
+ * An uninitialized, page-aligned array whose pages are first touched by a
+ * `threads`-wide team under schedule(static), so thread t's pages sit on
+ * its node when the consumer splits the array into `threads` contiguous
+ * blocks. Loops with other schedules or team sizes only get the pages
+ * spread over the nodes, not matched to the threads that read them.
+ */
+static inline int* placement_alloc_ints(long long n, int threads) {
+    size_t bytes = ((size_t) (n > 0 ? n : 1) * sizeof(int) + PLACEMENT_PAGE - 1) / PLACEMENT_PAGE * PLACEMENT_PAGE;
+    int* array = (int*) aligned_alloc(PLACEMENT_PAGE, bytes);
+    if (array == NULL)
+        return NULL;
+
+    long long pages = (long long) (bytes / PLACEMENT_PAGE);
+    long long ints_per_page = PLACEMENT_PAGE / sizeof(int);
+    #pragma omp parallel for num_threads(threads) schedule(static)
+    for (long long page = 0; page < pages; page++)
+        array[page * ints_per_page] = 0;
+    return array;
+}
+
+
+/* A first-touched private copy of the dataset, so the mapped file pages are not all read from one node */
+static inline int* placement_copy_dataset(const dataset* ds, int threads) {
+    int* array = placement_alloc_ints(ds->length, threads);
+    if (array != NULL)
+        dataset_copy(ds, array);
+    return array;
+}
+
+
+/* Share of a sample of the array's pages resident on each node; returns the number of nodes seen */
+static inline int placement_page_nodes(const void* data, size_t bytes, double* shares, int max_nodes) {
+    int seen = 0;
+    for (int node = 0; node < max_nodes; node++)
+        shares[node] = 0.0;
+#ifdef __linux__
+    long long pages = (long long) (bytes / PLACEMENT_PAGE);
+    int samples = pages < PLACEMENT_PAGE_SAMPLES ? (int) pages : PLACEMENT_PAGE_SAMPLES;
+    void* addresses[PLACEMENT_PAGE_SAMPLES];
+    int status[PLACEMENT_PAGE_SAMPLES];
+    uintptr_t base = (uintptr_t) data / PLACEMENT_PAGE * PLACEMENT_PAGE;
+
+    for (int s = 0; s < samples; s++)
+        addresses[s] = (void*) (base + (uintptr_t) (pages * s / samples) * PLACEMENT_PAGE);
+    if (samples == 0 || syscall(SYS_move_pages, 0, samples, addresses, NULL, status, 0) != 0)
+        return 0;
+
+    for (int s = 0; s < samples; s++)
+        if (status[s] >= 0 && status[s] < max_nodes) {
+            shares[status[s]] += 1.0 / samples;
+            seen = status[s] + 1 > seen ? status[s] + 1 : seen;
+        }
+#endif
+    return seen;
+}
+
+
+static inline void placement_report_pages(const char* label, const void* data, size_t bytes) {
+    double shares[PLACEMENT_MAX_NODES];
+    int nodes = placement_page_nodes(data, bytes, shares, PLACEMENT_MAX_NODES);
+    if (nodes == 0)
+        return;
+    printf("%s pages:", label);
+    for (int node = 0; node < nodes; node++)
+        printf(" node%d=%.0f%%", node, shares[node] * 100.0);
+    printf("\n");
+}
+
+
+/*
+ * Read bandwidth of every node on its own: one thread pinned to each CPU of
+ * the node first-touches and then sums its part of a `bytes` buffer. The
+ * threads get their previous affinity back afterwards. It allocates and
+ * reads `bytes` per node, so programs only run it when asked to.
+ */
+static inline void placement_node_bandwidth(long long bytes) {
+    placement_topology topology;
+    placement_topology_read(&topology);
+    long long n = bytes / (long long) sizeof(int);
+
+    for (int node = 0; node < topology.nodes; node++) {
+        int threads = topology.cpu_count[node];
+        if (threads == 0)
+            continue;
+
+        int* buffer = (int*) aligned_alloc(PLACEMENT_PAGE, (size_t) n * sizeof(int));
+        double best = 0.0;
+        long long sum = 0;
+        if (buffer == NULL)
+            return;
+
+        #pragma omp parallel num_threads(threads) reduction(+: sum)
+        {
+#ifdef __linux__
+            unsigned long long saved[PLACEMENT_MASK_WORDS] = {0}, pinned[PLACEMENT_MASK_WORDS] = {0};
+            int rank = omp_get_thread_num(), cpu = 0;
+            for (int seen = -1; cpu < PLACEMENT_MAX_CPUS; cpu++)
+                if (((topology.cpus[node][cpu / 64] >> (cpu % 64)) & 1) && ++seen == rank)
+                    break;
+            long saved_ok = syscall(SYS_sched_getaffinity, 0, sizeof(saved), saved);
+            if (cpu < PLACEMENT_MAX_CPUS) {
+                pinned[cpu / 64] = 1ULL << (cpu % 64);
+                syscall(SYS_sched_setaffinity, 0, sizeof(pinned), pinned);
+            }
+#endif
+            #pragma omp for schedule(static)
+            for (long long i = 0; i < n; i++)
+                buffer[i] = (int) i;
+
+            for (int repetition = 0; repetition < 3; repetition++) {
+                double start = 0.0;
+                #pragma omp barrier
+                #pragma omp master
+                start = bench_now();
+                #pragma omp for schedule(static)
+                for (long long i = 0; i < n; i++)
+                    sum += buffer[i];
+                #pragma omp master
+                {
+                    double seconds = bench_now() - start;
+                    if (best == 0.0 || seconds < best)
+                        best = seconds;
+                }
+            }
+#ifdef __linux__
+            if (saved_ok > 0)
+                syscall(SYS_sched_setaffinity, 0, sizeof(saved), saved);
+#endif
+        }
+
+        printf("node %d: %d cpus, read bandwidth %.2f GB/s (checksum %lld)\n", node, threads,
+               best > 0.0 ? (double) n * sizeof(int) / best * 1e-9 : 0.0, sum);
+        free(buffer);
+    }
+}
+
+#endif
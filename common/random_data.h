@@ -0,0 +1,93 @@
+#ifndef PAR_PROG_RANDOM_DATA_H
+#define PAR_PROG_RANDOM_DATA_H
+
+#include <stdint.h>
+
+#define SPLITMIX64_GAMMA 0x9E3779B97F4A7C15ULL
+#define FEW_UNIQUE_VALUES 16
+
+
+typedef enum {
+    DIST_RANDOM,
+    DIST_REVERSED,
+    DIST_PARTIALLY_SORTED,
+    DIST_FEW_UNIQUE,
+    DIST_ADVERSARIAL,
+    DIST_COUNT
+} data_distribution;
+
+
+static inline const char* data_distribution_name(data_distribution dist) {
+    switch (dist) {
+        case DIST_RANDOM:
+            return "random";
+        case DIST_REVERSED:
+            return "reversed";
+        case DIST_PARTIALLY_SORTED:
+            return "partially_sorted";
+        case DIST_FEW_UNIQUE:
+            return "few_unique";
+        case DIST_ADVERSARIAL:
+            return "adversarial";
+        default:
+            return "unknown";
+    }
+}
+
+
+/*
+ * Counter-based splitmix64: element `index` of the stream is the mix of the
+ * state the serial generator would have after index + 1 steps, so any slice
+ * can be produced independently and matches the serial sequence bit for bit.
+ */
+static inline uint64_t random_at(uint64_t seed, uint64_t index) {
+    uint64_t z = seed + (index + 1) * SPLITMIX64_GAMMA;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+
+/* Non-negative 31-bit value, the same range rand() gives with glibc */
+static inline int random_int_at(uint64_t seed, uint64_t index) {
+    return (int) (random_at(seed, index) >> 33);
+}
+
+
+static inline int data_value_at(data_distribution dist, long long length, long long index, uint64_t seed) {
+    long long quarter = length / 4;
+    switch (dist) {
+        case DIST_REVERSED:
+            return (int) (length - index);
+        case DIST_PARTIALLY_SORTED:
+            if (index < quarter || index >= length - quarter)
+                return random_int_at(seed, index);
+            return (int) index;
+        case DIST_FEW_UNIQUE:
+            return random_int_at(seed, index) % FEW_UNIQUE_VALUES;
+        case DIST_ADVERSARIAL:
+            /* Small half on odd positions, large half on even ones: every halving gap but 1 is a no-op */
+            if (index % 2 == 0)
+                return (int) ((length + 1) / 2 + index / 2);
+            return (int) (index / 2);
+        case DIST_RANDOM:
+        default:
+            return random_int_at(seed, index);
+    }
+}
+
+
+/* Fill out[0 .. end - begin) with elements [begin, end) of the logical array of `length` elements */
+static inline void generate_data_range(int* out, long long length, long long begin, long long end,
+                                       data_distribution dist, uint64_t seed) {
+    #pragma omp parallel for schedule(static)
+    for (long long i = begin; i < end; i++)
+        out[i - begin] = data_value_at(dist, length, i, seed);
+}
+
+
+static inline void generate_data(int* array, long long length, data_distribution dist, uint64_t seed) {
+    generate_data_range(array, length, 0, length, dist, seed);
+}
+
+#endif
@@ -0,0 +1,254 @@
+#ifndef PAR_PROG_TUNING_PROFILE_H
+#define PAR_PROG_TUNING_PROFILE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <omp.h>
+#include "bench.h"
+
+#define TUNING_PROFILE_ENV "TUNING_PROFILE"
+#define TUNING_PROFILE_DEFAULT_PATH "tuning_profile.txt"
+#define TUNING_MAX_ENTRIES 256
+#define TUNING_REPETITIONS 3
+#define TUNING_SWEEP_FACTOR 4
+
+
+/* The best schedule found for one kernel at one input size and thread count */
+typedef struct {
+    char kernel[BENCH_NAME_LENGTH];
+    long long size;
+    int threads;
+    omp_sched_t kind;
+    int chunk;              ///< 0 keeps the default chunk of the kind
+    double seconds;         ///< Best time measured with this schedule
+} tuning_entry;
+
+typedef struct {
+    int count;
+    tuning_entry entries[TUNING_MAX_ENTRIES];
+} tuning_profile;
+
+
+static inline const char* tuning_profile_path(void) {
+    const char* path = getenv(TUNING_PROFILE_ENV);
+    return path != NULL && path[0] != '\0' ? path : TUNING_PROFILE_DEFAULT_PATH;
+}
+
+
+static inline const char* schedule_kind_name(omp_sched_t kind) {
+    switch (kind) {
+        case omp_sched_static:
+            return "static";
+        case omp_sched_dynamic:
+            return "dynamic";
+        case omp_sched_guided:
+            return "guided";
+        case omp_sched_auto:
+            return "auto";
+        default:
+            return "unknown";
+    }
+}
+
+
+static inline int schedule_kind_parse(const char* name, omp_sched_t* kind) {
+    const omp_sched_t kinds[] = {omp_sched_static, omp_sched_dynamic, omp_sched_guided, omp_sched_auto};
+    for (int i = 0; i < 4; i++)
+        if (strcmp(name, schedule_kind_name(kinds[i])) == 0) {
+            *kind = kinds[i];
+            return 1;
+        }
+    return 0;
+}
+
+
+/* One entry per line: kernel size threads kind chunk seconds. A missing file is an empty profile */
+static inline void tuning_profile_load(tuning_profile* profile, const char* path) {
+    FILE* file = fopen(path, "r");
+    char line[512], kind[32];
+    profile->count = 0;
+    if (file == NULL)
+        return;
+
+    while (profile->count < TUNING_MAX_ENTRIES && fgets(line, sizeof(line), file)) {
+        tuning_entry* entry = &profile->entries[profile->count];
+        if (line[0] == '#')
+            continue;
+        if (sscanf(line, "%95s %lld %d %31s %d %lf", entry->kernel, &entry->size, &entry->threads, kind,
+                   &entry->chunk, &entry->seconds) == 6 && schedule_kind_parse(kind, &entry->kind))
+            profile->count++;
+    }
+    fclose(file);
+}
+
+
+static inline int tuning_profile_save(const tuning_profile* profile, const char* path) {
+    char tmp_path[4096];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    FILE* file = fopen(tmp_path, "w");
+    if (file == NULL) {
+        fprintf(stderr, "tuning: cannot write %s\n", tmp_path);
+        return -1;
+    }
+
+    fprintf(file, "# kernel size threads schedule chunk seconds\n");
+    for (int i = 0; i < profile->count; i++) {
+        const tuning_entry* entry = &profile->entries[i];
+        fprintf(file, "%s %lld %d %s %d %.9f\n", entry->kernel, entry->size, entry->threads,
+                schedule_kind_name(entry->kind), entry->chunk, entry->seconds);
+    }
+    if (fclose(file) != 0 || rename(tmp_path, path) != 0) {
+        fprintf(stderr, "tuning: cannot replace %s\n", path);
+        remove(tmp_path);
+        return -1;
+    }
+    return 0;
+}
+
+
+/* Replace the entry with the same kernel, size and thread count, or append */
+static inline void tuning_profile_update(tuning_profile* profile, const tuning_entry* entry) {
+    for (int i = 0; i < profile->count; i++) {
+        tuning_entry* existing = &profile->entries[i];
+        if (strcmp(existing->kernel, entry->kernel) == 0 && existing->size == entry->size &&
+            existing->threads == entry->threads) {
+            *existing = *entry;
+            return;
+        }
+    }
+    if (profile->count < TUNING_MAX_ENTRIES)
+        profile->entries[profile->count++] = *entry;
+}
+
+
+/* Closest entry for the kernel: the nearest thread count first, then the nearest size on a log scale */
+static inline const tuning_entry* tuning_profile_find(const tuning_profile* profile, const char* kernel,
+                                                      long long size, int threads) {
+    const tuning_entry* best = NULL;
+    double best_distance = 0.0;
+    for (int i = 0; i < profile->count; i++) {
+        const tuning_entry* entry = &profile->entries[i];
+        if (strcmp(entry->kernel, kernel) != 0)
+            continue;
+        double distance = fabs((double) (entry->threads - threads)) * 1000.0 +
+                          fabs(log((double) (entry->size > 0 ? entry->size : 1) / (double) (size > 0 ? size : 1)));
+        if (best == NULL || distance < best_distance) {
+            best = entry;
+            best_distance = distance;
+        }
+    }
+    return best;
+}
+
+
+/*
+ * Load the profile and hand the best known schedule for the kernel to
+ * omp_set_schedule, so schedule(runtime) loops pick it up. When the kernel
+ * was never tuned, OMP_SCHEDULE stays in charge if it is set; otherwise the
+ * schedule becomes static (libgomp would default to dynamic,1) and 0 is
+ * returned.
+ */
+static inline int tuning_apply(const char* kernel, long long size, int threads) {
+    tuning_profile* profile = (tuning_profile*) malloc(sizeof(tuning_profile));
+    const tuning_entry* entry = NULL;
+    if (profile != NULL) {
+        tuning_profile_load(profile, tuning_profile_path());
+        entry = tuning_profile_find(profile, kernel, size, threads);
+    }
+
+    int applied = entry != NULL;
+    if (applied)
+        omp_set_schedule(entry->kind, entry->chunk);
+    else if (getenv("OMP_SCHEDULE") == NULL)
+        omp_set_schedule(omp_sched_static, 0);
+    free(profile);
+    return applied;
+}
+
+
+static inline double tuning_measure(bench_config* cfg, const bench_kernel* kernel, omp_sched_t kind, int chunk) {
+    omp_set_schedule(kind, chunk);
+    bench_sample(cfg, kernel, NULL);
+
+    double best = 0.0;
+    for (int r = 0; r < TUNING_REPETITIONS; r++) {
+        double seconds = bench_sample(cfg, kernel, NULL);
+        if (r == 0 || seconds < best)
+            best = seconds;
+    }
+    return best;
+}
+
+
+static inline void tuning_try(bench_config* cfg, const bench_kernel* kernel, omp_sched_t kind, int chunk,
+                              tuning_entry* best) {
+    double seconds = tuning_measure(cfg, kernel, kind, chunk);
+    if (best->seconds == 0.0 || seconds < best->seconds) {
+        best->kind = kind;
+        best->chunk = chunk;
+        best->seconds = seconds;
+    }
+}
+
+
+/*
+ * Bounded search over the schedule kinds and chunk sizes of one kernel:
+ * the default chunk and a geometric sweep 1, 4, 16, ... up to
+ * iterations / threads for every kind, then a local refinement around the
+ * winner with factors 2, sqrt(2) and 2^(1/4). `iterations` is the trip
+ * count of the tuned loop. Every timing goes through cfg->sync_sample, so
+ * all MPI ranks see the same numbers and take the same path.
+ */
+static inline void tuning_search(bench_config* cfg, const bench_kernel* kernel, long long iterations,
+                                 const omp_sched_t* kinds, int kind_count, tuning_entry* best) {
+    const omp_sched_t default_kinds[] = {omp_sched_static, omp_sched_dynamic, omp_sched_guided};
+    if (kinds == NULL) {
+        kinds = default_kinds;
+        kind_count = sizeof(default_kinds) / sizeof(default_kinds[0]);
+    }
+
+    memset(best, 0, sizeof(*best));
+    snprintf(best->kernel, sizeof(best->kernel), "%s", kernel->name);
+    best->size = kernel->size;
+    best->threads = kernel->threads;
+
+    long long limit = iterations / (kernel->threads > 0 ? kernel->threads : 1);
+    for (int k = 0; k < kind_count; k++) {
+        tuning_try(cfg, kernel, kinds[k], 0, best);
+        for (long long chunk = 1; chunk <= limit && chunk <= (1 << 30); chunk *= TUNING_SWEEP_FACTOR)
+            tuning_try(cfg, kernel, kinds[k], (int) chunk, best);
+    }
+
+    for (double step = 2.0; best->chunk > 0 && step > 1.1; step = sqrt(step)) {
+        int center = best->chunk;
+        int lower = (int) (center / step);
+        int upper = (int) (center * step);
+        if (lower >= 1 && lower < center)
+            tuning_try(cfg, kernel, best->kind, lower, best);
+        if (upper > center && upper <= limit)
+            tuning_try(cfg, kernel, best->kind, upper, best);
+    }
+
+    omp_set_schedule(best->kind, best->chunk);
+    if (cfg->report)
+        printf("tuned %s n=%lld thr=%d: schedule=%s chunk=%d time=%.6f\n", best->kernel, best->size,
+               best->threads, schedule_kind_name(best->kind), best->chunk, best->seconds);
+}
+
+
+/* Merge freshly tuned entries into the profile file */
+static inline int tuning_profile_store(const tuning_entry* entries, int count) {
+    tuning_profile* profile = (tuning_profile*) malloc(sizeof(tuning_profile));
+    if (profile == NULL)
+        return -1;
+    tuning_profile_load(profile, tuning_profile_path());
+    for (int i = 0; i < count; i++)
+        tuning_profile_update(profile, &entries[i]);
+    int status = tuning_profile_save(profile, tuning_profile_path());
+    free(profile);
+    return status;
+}
+
+#endif
@@ -0,0 +1,180 @@
+#ifndef PAR_PROG_WORK_STEALING_H
+#define PAR_PROG_WORK_STEALING_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "locks.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#define WS_DEQUE_CAPACITY 64
+#define WS_MAX_THREADS 256
+#define WS_CACHE_LINE 64
+
+
+/*
+ * Chase-Lev deque of index ranges. The owner pushes and takes at the bottom,
+ * thieves steal the oldest range at the top. A range is split in halves on
+ * the way down, so every deque holds at most log2(range / grain) entries
+ * and the fixed ring never wraps onto a live slot.
+ */
+typedef struct {
+    _Alignas(WS_CACHE_LINE) atomic_llong top;
+    _Alignas(WS_CACHE_LINE) atomic_llong bottom;
+    atomic_llong begins[WS_DEQUE_CAPACITY];
+    atomic_llong ends[WS_DEQUE_CAPACITY];
+} ws_deque;
+
+/* Victim RNG of one thread, on a line of its own since every failed steal updates it */
+typedef struct {
+    _Alignas(WS_CACHE_LINE) uint64_t state;
+} ws_victim;
+
+typedef struct {
+    int threads;
+    long long grain;
+    ws_deque* deques;
+    _Alignas(WS_CACHE_LINE) atomic_llong remaining;   ///< Iterations not handed out yet
+    ws_victim victims[WS_MAX_THREADS];
+} ws_loop;
+
+
+static inline void ws_push(ws_deque* deque, long long begin, long long end) {
+    long long b = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+    atomic_store_explicit(&deque->begins[b % WS_DEQUE_CAPACITY], begin, memory_order_relaxed);
+    atomic_store_explicit(&deque->ends[b % WS_DEQUE_CAPACITY], end, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&deque->bottom, b + 1, memory_order_relaxed);
+}
+
+
+static inline int ws_take(ws_deque* deque, long long* begin, long long* end) {
+    long long b = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&deque->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    long long t = atomic_load_explicit(&deque->top, memory_order_relaxed);
+
+    if (t > b) {
+        atomic_store_explicit(&deque->bottom, b + 1, memory_order_relaxed);
+        return 0;
+    }
+    *begin = atomic_load_explicit(&deque->begins[b % WS_DEQUE_CAPACITY], memory_order_relaxed);
+    *end = atomic_load_explicit(&deque->ends[b % WS_DEQUE_CAPACITY], memory_order_relaxed);
+    if (t == b) {
+        /* Last entry: race the thieves for it */
+        int won = atomic_compare_exchange_strong_explicit(&deque->top, &t, t + 1, memory_order_seq_cst,
+                                                          memory_order_relaxed);
+        atomic_store_explicit(&deque->bottom, b + 1, memory_order_relaxed);
+        return won;
+    }
+    return 1;
+}
+
+
+static inline int ws_steal(ws_deque* deque, long long* begin, long long* end) {
+    long long t = atomic_load_explicit(&deque->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    long long b = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+    if (t >= b)
+        return 0;
+
+    *begin = atomic_load_explicit(&deque->begins[t % WS_DEQUE_CAPACITY], memory_order_relaxed);
+    *end = atomic_load_explicit(&deque->ends[t % WS_DEQUE_CAPACITY], memory_order_relaxed);
+    return atomic_compare_exchange_strong_explicit(&deque->top, &t, t + 1, memory_order_seq_cst,
+                                                   memory_order_relaxed);
+}
+
+
+/*
+ * Prepare a loop over [0, n) for a team of `threads`: thread t starts with
+ * the t-th contiguous block, as with schedule(static). A grain below 1
+ * picks 64 chunks per thread.
+ */
+static inline int ws_loop_init(ws_loop* loop, int threads, long long n, long long grain) {
+    memset(loop, 0, sizeof(*loop));
+    loop->threads = threads < 1 ? 1 : (threads > WS_MAX_THREADS ? WS_MAX_THREADS : threads);
+    loop->grain = grain > 0 ? grain : (n / (loop->threads * 64LL) > 0 ? n / (loop->threads * 64LL) : 1);
+    loop->deques = (ws_deque*) aligned_alloc(WS_CACHE_LINE, loop->threads * sizeof(ws_deque));
+    if (loop->deques == NULL)
+        return -1;
+    memset(loop->deques, 0, loop->threads * sizeof(ws_deque));
+
+    atomic_store(&loop->remaining, n);
+    for (int t = 0; t < loop->threads; t++) {
+        long long begin = n * t / loop->threads;
+        long long end = n * (t + 1) / loop->threads;
+        if (begin < end)
+            ws_push(&loop->deques[t], begin, end);
+        loop->victims[t].state = 0x9E3779B97F4A7C15ULL * (t + 1);
+    }
+    return 0;
+}
+
+
+static inline void ws_loop_destroy(ws_loop* loop) {
+    free(loop->deques);
+    loop->deques = NULL;
+}
+
+
+/* Try every other deque once, starting from a random victim */
+static inline int ws_steal_any(ws_loop* loop, int thread, long long* begin, long long* end) {
+    uint64_t x = loop->victims[thread].state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    loop->victims[thread].state = x;
+
+    int first = (int) (x % loop->threads);
+    for (int k = 0; k < loop->threads; k++) {
+        int victim = (first + k) % loop->threads;
+        if (victim != thread && ws_steal(&loop->deques[victim], begin, end))
+            return 1;
+    }
+    return 0;
+}
+
+
+/*
+ * Hand the calling thread its next chunk of at most `grain` iterations;
+ * returns 0 once the whole range has been handed out. Meant to replace an
+ * `omp for` inside a parallel region:
+ *
+ *     while (ws_loop_next(&loop, omp_get_thread_num(), &begin, &end))
+ *         for (long long i = begin; i < end; i++) ...
+ *
+ * A taken or stolen range is halved until it fits the grain, and the upper
+ * halves go back on the owner's deque, so a thief always steals the largest
+ * piece left, about half of what the victim still has. A thread that finds
+ * nothing while others still hold work backs off before it looks again.
+ */
+static inline int ws_loop_next(ws_loop* loop, int thread, long long* begin, long long* end) {
+    if (thread >= loop->threads)
+        return 0;
+
+    ws_deque* own = &loop->deques[thread];
+    int spins = 0;
+    for (;;) {
+        long long b, e;
+        if (ws_take(own, &b, &e) || ws_steal_any(loop, thread, &b, &e)) {
+            while (e - b > loop->grain) {
+                long long middle = b + (e - b) / 2;
+                ws_push(own, middle, e);
+                e = middle;
+            }
+            atomic_fetch_sub_explicit(&loop->remaining, e - b, memory_order_relaxed);
+            *begin = b;
+            *end = e;
+            return 1;
+        }
+        if (atomic_load_explicit(&loop->remaining, memory_order_relaxed) == 0)
+            return 0;
+        lock_backoff(&spins);
+    }
+}
+
+#endif
@@ -1,106 +1,186 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
+#include <limits.h>
 #include "omp.h"
-
-
-int* array_creation(int length, int random_seed){
-    int* array = (int*) calloc(length, sizeof(int));
-
-    for (int i = 0; i < length; i++)
-        (array)[i] = rand();
-
-    return array;
+#include "../common/dataset_cache.h"
+#include "../common/bench.h"
+#include "../common/tuning_profile.h"
+#include "../common/placement.h"
+#include "../common/max_kernels.h"
+
+#define CACHE_LINE_INTS 16
+#define MAX_TILE_INTS 4096
+#define NODE_BANDWIDTH_BYTES (256LL << 20)
+
+
+typedef struct {
+    int n;
+    int threads;
+    const int* array;
+    max_kernel_t kernel;
+    int max;
+} max_benchmark;
+
+
+void sequential_find_max(int n, const int* array, int* max, max_kernel_t kernel){
+    int _max = kernel(array, n);
+    if (_max > *max)
+        *max = _max;
 }
 
 
-void sequential_find_max(int n, const int* array, int* max){
-    for (int i = 0; i < n; i++)
-        if (array[i] > *max)
-            *max = array[i];
+void run_sequential_max(void* ctx){
+    max_benchmark* benchmark = (max_benchmark*) ctx;
+    benchmark->max = -1;
+    sequential_find_max(benchmark->n, benchmark->array, &benchmark->max, benchmark->kernel);
 }
 
 
-int sequential_calculations(int n, int avg, int random_seed){
-    int max = -1;
-    double time = 0.0, start, end;
-    for (int iter = 0; iter < avg; iter++) {
-        int* array = array_creation(n, random_seed);
-        max = -1;
+int sequential_calculations(int n, bench_config* bench, const int* array){
+    max_benchmark benchmark = {n, 1, array, NULL, -1};
 
-        start = omp_get_wtime();
-        sequential_find_max(n, array, &max);
-        end = omp_get_wtime();
+    for (int k = 0; k < max_kernels_count; k++) {
+        if (!max_kernels[k].supported())
+            continue;
 
-        time += end - start;
-        free(array);
+        char name[BENCH_NAME_LENGTH];
+        snprintf(name, sizeof(name), "sequential_max/%s", max_kernels[k].name);
+        benchmark.kernel = max_kernels[k].kernel;
+        bench_kernel kernel = {name, data_distribution_name(DIST_RANDOM), n, 1, 1, (double) n * sizeof(int),
+                               NULL, run_sequential_max, &benchmark};
+        bench_result result;
+        bench_run(bench, &kernel, &result);
     }
-
-    time /= avg;
-    printf("SEQUENTIAL TIME: %lf\n\n", time);
-
-    return max;
+    printf("\n");
+    return benchmark.max;
 }
 
 
-void parallel_find_max(int n, int threads, const int* array, int* max){
+/*
+ * The vector kernel runs over cache-line aligned tiles; how tiles are dealt
+ * to threads comes from omp_set_schedule. The default static schedule gives
+ * every thread one contiguous slice.
+ */
+void parallel_find_max(int n, int threads, const int* array, int* max, max_kernel_t kernel){
     int _max = -1;
-    #pragma omp parallel num_threads(threads) shared(array, n) reduction(max: _max) default(none)
-    #pragma omp for
-    for (int i = 0; i < n; i++)
-        if (array[i] > _max)
-            _max = array[i];
+    int tiles = (n + MAX_TILE_INTS - 1) / MAX_TILE_INTS;
+    #pragma omp parallel for num_threads(threads) schedule(runtime) shared(array, n, kernel, tiles) \
+            reduction(max: _max) default(none)
+    for (int tile = 0; tile < tiles; tile++) {
+        int begin = tile * MAX_TILE_INTS;
+        int length = n - begin < MAX_TILE_INTS ? n - begin : MAX_TILE_INTS;
+        int tile_max = kernel(array + begin, length);
+        if (tile_max > _max)
+            _max = tile_max;
+    }
     *max = _max;
 }
 
 
-int parallel_time(int n, int avg, int random_seed){
-    int max = -1;
-    for (int threads = 2; threads <= omp_get_num_procs(); threads++) {
-        double time = 0.0, start, end;
-        for (int i = 0; i < avg; i++) {
-            int* array = array_creation(n, random_seed);
-            max = -1;
+void run_parallel_max(void* ctx){
+    max_benchmark* benchmark = (max_benchmark*) ctx;
+    parallel_find_max(benchmark->n, benchmark->threads, benchmark->array, &benchmark->max, benchmark->kernel);
+}
+
 
-            start = omp_get_wtime();
-            parallel_find_max(n, threads, array, &max);
-            end = omp_get_wtime();
+int parallel_time(int n, bench_config* bench, const int* array){
+    max_benchmark benchmark = {n, 1, array, NULL, -1};
 
-            time += end - start;
-            free(array);
+    for (int threads = 2; threads <= omp_get_num_procs(); threads++) {
+        tuning_apply("lab1/parallel_max", n, threads);
+        for (int k = 0; k < max_kernels_count; k++) {
+            if (!max_kernels[k].supported())
+                continue;
+
+            char name[BENCH_NAME_LENGTH];
+            snprintf(name, sizeof(name), "parallel_max/%s", max_kernels[k].name);
+            benchmark.threads = threads;
+            benchmark.kernel = max_kernels[k].kernel;
+            bench_kernel kernel = {name, data_distribution_name(DIST_RANDOM), n, threads, 1, (double) n * sizeof(int),
+                                   NULL, run_parallel_max, &benchmark};
+            bench_result result;
+            bench_run(bench, &kernel, &result);
         }
+        printf("\n");
+    }
+    return benchmark.max;
+}
+
 
-        time /= avg;
-        printf("PARALLEL (%d thr): TIME = %lf;\n", threads, time);
+/* Tune the schedule of parallel_find_max with the best kernel for every thread count of the sweep */
+void autotune(int n, bench_config* bench, const int* array){
+    int counts = omp_get_num_procs() > 1 ? omp_get_num_procs() - 1 : 1;
+    tuning_entry* best = (tuning_entry*) malloc(counts * sizeof(tuning_entry));
+    for (int c = 0; c < counts; c++) {
+        int threads = omp_get_num_procs() > 1 ? c + 2 : 1;
+        max_benchmark benchmark = {n, threads, array, select_max_kernel()->kernel, -1};
+        bench_kernel kernel = {"lab1/parallel_max", data_distribution_name(DIST_RANDOM), n, threads, 1,
+                               (double) n * sizeof(int), NULL, run_parallel_max, &benchmark};
+        tuning_search(bench, &kernel, (n + MAX_TILE_INTS - 1) / MAX_TILE_INTS, NULL, 0, &best[c]);
     }
-    return max;
+    tuning_profile_store(best, counts);
+    free(best);
 }
 
 
+/* Usage: lab1 [--bind=<policy>] [--places=<places>] [--autotune] [--node-bandwidth] */
 int main(int argc, char** argv)
 {
+    placement_configure(&argc, argv);
+    int tune = 0;
+    int node_bandwidth = 0;
+    for (int a = 1; a < argc; a++) {
+        tune |= strcmp(argv[a], "--autotune") == 0;
+        node_bandwidth |= strcmp(argv[a], "--node-bandwidth") == 0;
+    }
+
     /* Determine the OpenMP support */
     printf("OpenMP: %d\n", _OPENMP);
-    printf("threads_num: %d\n\n", omp_get_num_procs());
+    printf("threads_num: %d\n", omp_get_num_procs());
+    printf("max kernel: %s\n", select_max_kernel()->name);
+    placement_report();
+    if (node_bandwidth)
+        placement_node_bandwidth(NODE_BANDWIDTH_BYTES);
 
     const int n_array = 10000000;         ///< Number of array elements
-    const int avg = 10;                     ///< Number of calculations before
+    const int avg = 10;                     ///< Minimal number of timed repetitions
     const int random_seed = 920215;         ///< RNG seed
     int seq_max;                            ///< The maximal element for sequential algorithm
     int par_max;                            ///< The maximal element for parallel algorithm
 
-    /* Initialize the RNG */
-    srand(random_seed);
+    bench_config bench;
+    bench_config_default(&bench);
+    bench.min_repetitions = avg;
+    bench_config_env(&bench);
+
+    /* The compute threads first-touch their own slice of the input */
+    dataset input;
+    if (dataset_open(&input, DIST_RANDOM, n_array, random_seed, 0) != 0)
+        return 1;
+    int* array = placement_copy_dataset(&input, omp_get_num_procs());
+    dataset_close(&input);
+    if (array == NULL)
+        return 1;
+    placement_report_pages("input", array, (size_t) n_array * sizeof(int));
+
+    if (tune)
+        autotune(n_array, &bench, array);
+    else if (tuning_apply("lab1/parallel_max", n_array, omp_get_num_procs()))
+        printf("schedule: tuned profile %s, applied per thread count\n", tuning_profile_path());
+    printf("\n");
 
     /* Calculate sequential time */
-    seq_max = sequential_calculations(n_array, avg, random_seed);
+    seq_max = sequential_calculations(n_array, &bench, array);
 
     /* Calculate parallel time */
-    par_max = parallel_time(n_array, avg, random_seed);
+    par_max = parallel_time(n_array, &bench, array);
+    free(array);
 
     printf("======\nSeq_Max is: %d;\n", seq_max);
     printf("======\nPar_Max is: %d;\n", par_max);
 
-    return 0;
+    return bench_finish(&bench) > 0;
 }
 
 
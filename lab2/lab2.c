@@ -1,38 +1,196 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include "omp.h"
-
-
-
-int power(int value, int power){
+#include "../common/dataset_cache.h"
+#include "../common/bench.h"
+#include "../common/tuning_profile.h"
+#include "../common/placement.h"
+
+#define CACHE_LINE_INTS 16
+#define SEARCH_CLAIM_LINES 256
+#define POWER_MODULUS 131
+#define PREDICATE_TABLE_LIMIT 4096
+#define PREDICATE_SIMD_LIMIT 65536
+#define SEARCH_MATCH_CAPACITY 64
+#define HARD_SENTINEL (POWER_MODULUS * 1000)   ///< The only element with power() == 0 once clear_hard_matches ran
+
+/* Build the vector predicate for the widest ISA and pick the clone at load time */
+#if defined(__x86_64__) && defined(__linux__) && defined(__GNUC__) && !defined(__clang__)
+#define VECTOR_CLONES __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define VECTOR_CLONES
+#endif
+
+
+typedef enum {
+    SEARCH_FIRST,       ///< Lowest matching index, like sequential_find
+    SEARCH_ANY,         ///< Whichever match is seen first
+    SEARCH_ALL          ///< Every matching index in ascending order
+} search_mode;
+
+typedef enum {
+    PREDICATE_EQUAL,
+    PREDICATE_POWER,        ///< Reference scalar power_mod, one element at a time
+    PREDICATE_TABLE,        ///< Lookup of the residue, for moduli up to PREDICATE_TABLE_LIMIT
+    PREDICATE_POWER_SIMD    ///< Squaring rounds evaluated a cache line of lanes at a time
+} predicate_kind;
+
+typedef struct {
+    predicate_kind kind;
+    int target;
+    int exponent;
+    int modulus;
+    uint64_t barrett;               ///< floor(2^32 / modulus)
+    unsigned char* table;           ///< table[|value| % modulus] != 0 if the value matches
+} search_predicate;
+
+
+int power_mod(int value, int power, int modulus){
     unsigned long long result = value;
     for (int i = 0; i < power; i++){
         result *= result;
-        result %= 131;
+        result %= modulus;
     }
     return (int) result;
 }
 
 
-int* array_creation(int length, int random_seed){
-    int* array = (int*) calloc(length, sizeof(int));
+int power(int value, int power){
+    return power_mod(value, power, POWER_MODULUS);
+}
 
-    for (int i = 0; i < length; i++)
-        (array)[i] = rand();
 
-    return array;
+/* x % modulus for x < 2^32 and modulus < 2^16, without a division, so it vectorizes */
+static inline uint32_t barrett_reduce(uint32_t x, uint64_t barrett, uint32_t modulus){
+    uint32_t r = x - (uint32_t) (((uint64_t) x * barrett) >> 32) * modulus;
+    return r >= modulus ? r - modulus : r;
 }
 
 
-int sequential_hard_find(int n, const int* array, int target){
-    int index = -1;
-    for (int i = 0; i < n; i++) {
-        if (power(array[i], 50) == target) {
-            index = i;
-            return index;
-        }
+/*
+ * After the first squaring only the residue is left, and squaring the
+ * 64-bit two's complement of a negative int gives value^2 as well, so
+ * power_mod(value, e, m) depends only on |value| % m for e > 0.
+ */
+static inline uint32_t magnitude(int value){
+    return value < 0 ? (uint32_t) 0 - (uint32_t) value : (uint32_t) value;
+}
+
+
+search_predicate make_equal_predicate(int target){
+    search_predicate predicate = {PREDICATE_EQUAL, target, 0, 0, 0, NULL};
+    return predicate;
+}
+
+
+/* Picks the cheapest exact evaluation of power_mod(value, exponent, modulus) == target */
+search_predicate make_power_predicate(int target, int exponent, int modulus){
+    search_predicate predicate = {PREDICATE_POWER, target, exponent, modulus, 0, NULL};
+    if (exponent <= 0 || modulus <= 0 || modulus >= PREDICATE_SIMD_LIMIT)
+        return predicate;
+
+    predicate.barrett = ((uint64_t) 1 << 32) / (uint64_t) modulus;
+    if (modulus > PREDICATE_TABLE_LIMIT) {
+        predicate.kind = PREDICATE_POWER_SIMD;
+        return predicate;
     }
-    return index;
+
+    predicate.table = (unsigned char*) malloc(modulus);
+    for (int residue = 0; residue < modulus; residue++)
+        predicate.table[residue] = power_mod(residue, exponent, modulus) == target;
+    predicate.kind = PREDICATE_TABLE;
+    return predicate;
+}
+
+
+void release_predicate(search_predicate* predicate){
+    free(predicate->table);
+    predicate->table = NULL;
+}
+
+
+int predicate_match(const search_predicate* predicate, int value){
+    uint32_t r;
+    switch (predicate->kind) {
+        case PREDICATE_POWER:
+            return power_mod(value, predicate->exponent, predicate->modulus) == predicate->target;
+        case PREDICATE_TABLE:
+            return predicate->table[barrett_reduce(magnitude(value), predicate->barrett, predicate->modulus)];
+        case PREDICATE_POWER_SIMD:
+            r = barrett_reduce(magnitude(value), predicate->barrett, predicate->modulus);
+            for (int k = 0; k < predicate->exponent; k++)
+                r = barrett_reduce(r * r, predicate->barrett, predicate->modulus);
+            return (int) r == predicate->target;
+        case PREDICATE_EQUAL:
+        default:
+            return value == predicate->target;
+    }
+}
+
+
+/* Does any element of one full cache line match? Every case runs as 16-lane vector code */
+VECTOR_CLONES
+int line_has_match(const search_predicate* predicate, const int* line){
+    uint32_t residues[CACHE_LINE_INTS];
+    const uint64_t barrett = predicate->barrett;
+    const uint32_t modulus = (uint32_t) predicate->modulus;
+    const int target = predicate->target;
+    int hit = 0;
+
+    switch (predicate->kind) {
+        case PREDICATE_EQUAL:
+            #pragma omp simd reduction(|: hit)
+            for (int j = 0; j < CACHE_LINE_INTS; j++)
+                hit |= line[j] == target;
+            return hit;
+        case PREDICATE_TABLE:
+            #pragma omp simd
+            for (int j = 0; j < CACHE_LINE_INTS; j++)
+                residues[j] = barrett_reduce(magnitude(line[j]), barrett, modulus);
+            for (int j = 0; j < CACHE_LINE_INTS; j++)
+                hit |= predicate->table[residues[j]];
+            return hit;
+        case PREDICATE_POWER_SIMD:
+            #pragma omp simd
+            for (int j = 0; j < CACHE_LINE_INTS; j++)
+                residues[j] = barrett_reduce(magnitude(line[j]), barrett, modulus);
+            for (int k = 0; k < predicate->exponent; k++) {
+                #pragma omp simd
+                for (int j = 0; j < CACHE_LINE_INTS; j++)
+                    residues[j] = barrett_reduce(residues[j] * residues[j], barrett, modulus);
+            }
+            #pragma omp simd reduction(|: hit)
+            for (int j = 0; j < CACHE_LINE_INTS; j++)
+                hit |= (int) residues[j] == target;
+            return hit;
+        case PREDICATE_POWER:
+        default:
+            return 1;
+    }
+}
+
+
+/* First match in [begin, end), or -1; a full line is tested as a vector before it is scanned */
+long long find_in_block(const search_predicate* predicate, const int* array, long long begin, long long end){
+    if (end - begin == CACHE_LINE_INTS && !line_has_match(predicate, array + begin))
+        return -1;
+    for (long long i = begin; i < end; i++)
+        if (predicate_match(predicate, array[i]))
+            return i;
+    return -1;
+}
+
+
+int sequential_hard_find(int n, const int* array, const search_predicate* predicate){
+    for (long long line = 0; line < n; line += CACHE_LINE_INTS) {
+        long long index = find_in_block(predicate, array, line, line + CACHE_LINE_INTS < n ? line + CACHE_LINE_INTS : n);
+        if (index >= 0)
+            return (int) index;
+    }
+    return -1;
 }
 
 
@@ -48,144 +206,384 @@ int sequential_find(int n, const int* array, int target){
 }
 
 
-void sequential_calculations(int n, int avg, int random_seed){
-    double time = 0.0, start, end;
-    for (int iter = 0; iter < avg; iter++) {
-        int* array = array_creation(n, random_seed);
-        array[0] = -1;
-        int target = -1;
+typedef struct {
+    int n;
+    int threads;
+    const int* array;
+    int target;
+    int index;
+    search_predicate hard;          ///< power(value, 50) == target, prepared once per target
+    search_mode mode;               ///< For run_parallel_search, which looks for `target`
+    long long* matches;
+    long long capacity;
+    long long result;
+} search_benchmark;
 
-        start = omp_get_wtime();
-        sequential_hard_find(n, array, target);
-        end = omp_get_wtime();
 
-        time += end - start;
-        free(array);
-    }
+void run_sequential_hard_find(void* ctx){
+    search_benchmark* benchmark = (search_benchmark*) ctx;
+    benchmark->index = sequential_hard_find(benchmark->n, benchmark->array, &benchmark->hard);
+}
 
-    time /= avg;
-    printf("BEST SEQUENTIAL TIME: %lf\n", time);
 
-    time = 0.0;
-    for (int iter = 0; iter < avg; iter++) {
-        int* array = array_creation(n, random_seed);
-        array[n - 1] = -1;
-        int target = -1;
+void run_sequential_find(void* ctx){
+    search_benchmark* benchmark = (search_benchmark*) ctx;
+    benchmark->index = sequential_find(benchmark->n, benchmark->array, benchmark->target);
+}
 
-        start = omp_get_wtime();
-        sequential_hard_find(n, array, target);
-        end = omp_get_wtime();
 
-        time += end - start;
-        free(array);
+/*
+ * Every multiple of POWER_MODULUS gets its lowest bit flipped, which
+ * moves it off residue 0, so the planted HARD_SENTINEL is the only element
+ * the hard search can stop at and the best and worst cases are real.
+ */
+void clear_hard_matches(int* array, int n){
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < n; i++)
+        if (array[i] % POWER_MODULUS == 0)
+            array[i] ^= 1;
+}
+
+
+/* The sentinels -1 and HARD_SENTINEL are placed first for the best case and last for the worst case */
+void sequential_calculations(int n, bench_config* bench, int* array){
+    search_benchmark benchmark = {n, 1, array, -1, -1,
+                                  make_power_predicate(power(HARD_SENTINEL, 50), 50, POWER_MODULUS),
+                                  SEARCH_FIRST, NULL, 0, -1};
+    const char* find_names[] = {"sequential_find/best", "sequential_find/worst"};
+    const char* names[] = {"sequential_hard_find/best", "sequential_hard_find/worst"};
+    const int positions[] = {0, n - 1};
+
+    for (int c = 0; c < 2; c++) {
+        int saved = array[positions[c]];
+        bench_kernel find_kernel = {find_names[c], data_distribution_name(DIST_RANDOM), n, 1, 1,
+                                    (double) (positions[c] + 1) * sizeof(int), NULL, run_sequential_find, &benchmark};
+        bench_kernel kernel = {names[c], data_distribution_name(DIST_RANDOM), n, 1, 1,
+                               (double) (positions[c] + 1) * sizeof(int), NULL, run_sequential_hard_find, &benchmark};
+        bench_result result;
+
+        array[positions[c]] = -1;
+        bench_run(bench, &find_kernel, &result);
+        array[positions[c]] = HARD_SENTINEL;
+        bench_run(bench, &kernel, &result);
+        if (benchmark.index != positions[c])
+            printf("sequential_hard_find returned %d instead of %d\n", benchmark.index, positions[c]);
+
+        array[positions[c]] = saved;
     }
+    release_predicate(&benchmark.hard);
+    printf("\n");
+}
 
-    time /= avg;
-    printf("WORST SEQUENTIAL TIME: %lf\n\n", time);
+
+void atomic_min_index(atomic_llong* found, long long index){
+    long long current = atomic_load_explicit(found, memory_order_relaxed);
+    while (index < current &&
+           !atomic_compare_exchange_weak_explicit(found, &current, index, memory_order_relaxed, memory_order_relaxed))
+        ;
 }
 
 
-int parallel_find(int n, int threads, const int* array, int target){
-    int index = -1;
-    #pragma omp parallel num_threads(threads) shared(array, n, target, index) default(none)
-    #pragma omp for
-    for (int i = 0; i < n; i++) {
-        if (array[i] == target) {
-            #pragma omp critical
-            {
-                index = array[i];
+/*
+ * Threads claim runs of cache lines in ascending order and publish matches
+ * through an atomic min. A thread stops as soon as the line it is about to
+ * scan starts past the published index, so no lower match can be missed.
+ * The chunk of omp_set_schedule, if any, is the number of lines per claim.
+ */
+long long search_first(const int* array, long long n, int threads, const search_predicate* predicate,
+                       search_mode mode){
+    atomic_llong next_line = 0;
+    atomic_llong found = n;
+    omp_sched_t kind;
+    int chunk;
+    omp_get_schedule(&kind, &chunk);
+    const long long claim_lines = chunk > 0 ? chunk : SEARCH_CLAIM_LINES;
+    const long long claim = claim_lines * CACHE_LINE_INTS;
+
+    #pragma omp parallel num_threads(threads) \
+            shared(array, n, predicate, mode, next_line, found, claim_lines, claim) default(none)
+    {
+        int searching = 1;
+        while (searching) {
+            long long begin = atomic_fetch_add_explicit(&next_line, claim_lines, memory_order_relaxed)
+                              * CACHE_LINE_INTS;
+            long long end = begin + claim < n ? begin + claim : n;
+            if (begin >= end)
+                break;
+
+            for (long long line = begin; line < end; line += CACHE_LINE_INTS) {
+                long long limit = atomic_load_explicit(&found, memory_order_relaxed);
+                if (line >= limit || (mode == SEARCH_ANY && limit < n)) {
+                    searching = 0;
+                    break;
+                }
+
+                long long line_end = line + CACHE_LINE_INTS < end ? line + CACHE_LINE_INTS : end;
+                long long index = find_in_block(predicate, array, line, line_end);
+                if (index >= 0) {
+                    atomic_min_index(&found, index);
+                    /* Later claims of this thread only cover higher indices */
+                    searching = 0;
+                    break;
+                }
             }
-            #pragma omp cancel for
         }
-        #pragma omp cancellation point for
     }
-    return index;
+
+    long long index = atomic_load(&found);
+    return index < n ? index : -1;
 }
 
 
-int parallel_max_find(int n, int threads, const int* array, int target){
-    int index = -1;
-#pragma omp parallel num_threads(threads) shared(array, n, target, index) default(none)
-#pragma omp for
-    for (int i = 0; i < n; i++) {
-        if (power(array[i], 50) == target) {
-#pragma omp critical
-            {
-                index = array[i];
-            }
-#pragma omp cancel for
-        }
-#pragma omp cancellation point for
+/* Two passes over contiguous per-thread slices: count, prefix sum, then write in order */
+long long search_all(const int* array, long long n, int threads, const search_predicate* predicate,
+                     long long* matches, long long capacity){
+    long long* offsets = (long long*) calloc(threads + 1, sizeof(long long));
+
+    #pragma omp parallel num_threads(threads) shared(array, n, predicate, matches, capacity, offsets) default(none)
+    {
+        int thread = omp_get_thread_num();
+        int count = omp_get_num_threads();
+        long long lines = (n + CACHE_LINE_INTS - 1) / CACHE_LINE_INTS;
+        long long begin = lines * thread / count * CACHE_LINE_INTS;
+        long long end = lines * (thread + 1) / count * CACHE_LINE_INTS;
+        if (end > n)
+            end = n;
+
+        long long found = 0;
+        for (long long i = begin; i < end; i++)
+            found += predicate_match(predicate, array[i]);
+        offsets[thread + 1] = found;
+
+        #pragma omp barrier
+        #pragma omp single
+        for (int t = 0; t < count; t++)
+            offsets[t + 1] += offsets[t];
+
+        long long position = offsets[thread];
+        for (long long i = begin; i < end && matches != NULL && position < capacity; i++)
+            if (predicate_match(predicate, array[i]))
+                matches[position++] = i;
     }
-    return index;
+
+    long long total = offsets[threads];
+    free(offsets);
+    return total;
+}
+
+
+/* FIRST and ANY return an index or -1, ALL returns the number of matches */
+long long parallel_search(const int* array, long long n, int threads, const search_predicate* predicate,
+                          search_mode mode, long long* matches, long long capacity){
+    if (mode == SEARCH_ALL)
+        return search_all(array, n, threads, predicate, matches, capacity);
+    return search_first(array, n, threads, predicate, mode);
+}
+
+
+int parallel_find(int n, int threads, const int* array, int target){
+    search_predicate predicate = make_equal_predicate(target);
+    return (int) parallel_search(array, n, threads, &predicate, SEARCH_FIRST, NULL, 0);
+}
+
+
+int parallel_max_find(int n, int threads, const int* array, const search_predicate* predicate){
+    return (int) parallel_search(array, n, threads, predicate, SEARCH_FIRST, NULL, 0);
+}
+
+
+void run_parallel_find(void* ctx){
+    search_benchmark* benchmark = (search_benchmark*) ctx;
+    benchmark->index = parallel_find(benchmark->n, benchmark->threads, benchmark->array, benchmark->target);
+}
+
+
+void run_parallel_hard_find(void* ctx){
+    search_benchmark* benchmark = (search_benchmark*) ctx;
+    benchmark->index = parallel_max_find(benchmark->n, benchmark->threads, benchmark->array, &benchmark->hard);
 }
 
 
-void parallel_time(int n, int avg, int random_seed){
+void run_parallel_search(void* ctx){
+    search_benchmark* benchmark = (search_benchmark*) ctx;
+    search_predicate predicate = make_equal_predicate(benchmark->target);
+    benchmark->result = parallel_search(benchmark->array, benchmark->n, benchmark->threads, &predicate,
+                                        benchmark->mode, benchmark->matches, benchmark->capacity);
+}
+
+
+/* Every match of ALL must be the next one sequential_find sees, and none may be missing */
+int check_all_matches(int n, const int* array, int target, const long long* matches, long long count){
+    long long checked = 0;
+    for (long long position = 0; position < n; checked++) {
+        int index = sequential_find((int) (n - position), array + position, target);
+        if (index < 0)
+            break;
+        if (checked >= count || (checked < SEARCH_MATCH_CAPACITY && matches[checked] != position + index))
+            return 0;
+        position += index + 1;
+    }
+    return checked == count;
+}
+
+
+/* ANY and ALL with the sentinel -1 at the first, middle and last element */
+void parallel_modes_time(int n, bench_config* bench, int* array){
+    long long matches[SEARCH_MATCH_CAPACITY];
+    search_benchmark benchmark = {n, 1, array, -1, -1, make_equal_predicate(-1), SEARCH_ANY, matches,
+                                  SEARCH_MATCH_CAPACITY, -1};
+    const int positions[] = {0, n / 2, n - 1};
+    int saved[3];
+    for (int c = 0; c < 3; c++) {
+        saved[c] = array[positions[c]];
+        array[positions[c]] = -1;
+    }
+
     for (int threads = 2; threads <= omp_get_num_procs(); threads++) {
-        double time = 0.0, start, end;
-        for (int i = 0; i < avg; i++) {
-            int* array = array_creation(n, random_seed);
-            array[0] = -1;
-            int target = -1;
-
-            start = omp_get_wtime();
-            parallel_max_find(n, threads, array, target);
-            end = omp_get_wtime();
-
-            time += end - start;
-            free(array);
+        tuning_apply("lab2/parallel_hard_find", n, threads);
+        benchmark.threads = threads;
+        bench_kernel any_kernel = {"parallel_find_any", data_distribution_name(DIST_RANDOM), n, threads, 1,
+                                   0.0, NULL, run_parallel_search, &benchmark};
+        bench_kernel all_kernel = {"parallel_find_all", data_distribution_name(DIST_RANDOM), n, threads, 1,
+                                   (double) n * sizeof(int), NULL, run_parallel_search, &benchmark};
+        bench_result result;
+
+        benchmark.mode = SEARCH_ANY;
+        bench_run(bench, &any_kernel, &result);
+        if (benchmark.result < 0 || benchmark.result >= n || array[benchmark.result] != benchmark.target)
+            printf("parallel_find_any returned %lld, which does not match\n", benchmark.result);
+
+        benchmark.mode = SEARCH_ALL;
+        bench_run(bench, &all_kernel, &result);
+        if (!check_all_matches(n, array, benchmark.target, matches, benchmark.result))
+            printf("parallel_find_all returned %lld matches that differ from sequential_find\n", benchmark.result);
+    }
+
+    for (int c = 0; c < 3; c++)
+        array[positions[c]] = saved[c];
+    printf("\n");
+}
+
+
+void parallel_time(int n, bench_config* bench, int* array){
+    search_benchmark benchmark = {n, 1, array, -1, -1,
+                                  make_power_predicate(power(HARD_SENTINEL, 50), 50, POWER_MODULUS),
+                                  SEARCH_FIRST, NULL, 0, -1};
+    const char* find_names[] = {"parallel_find/best", "parallel_find/worst"};
+    const char* names[] = {"parallel_hard_find/best", "parallel_hard_find/worst"};
+    const int positions[] = {0, n - 1};
+
+    for (int c = 0; c < 2; c++) {
+        int saved = array[positions[c]];
+
+        for (int threads = 2; threads <= omp_get_num_procs(); threads++) {
+            tuning_apply("lab2/parallel_hard_find", n, threads);
+            benchmark.threads = threads;
+            bench_kernel find_kernel = {find_names[c], data_distribution_name(DIST_RANDOM), n, threads, 1,
+                                        (double) (positions[c] + 1) * sizeof(int), NULL, run_parallel_find, &benchmark};
+            bench_kernel kernel = {names[c], data_distribution_name(DIST_RANDOM), n, threads, 1,
+                                   (double) (positions[c] + 1) * sizeof(int), NULL, run_parallel_hard_find,
+                                   &benchmark};
+            bench_result result;
+
+            array[positions[c]] = -1;
+            bench_run(bench, &find_kernel, &result);
+            if (benchmark.index != positions[c])
+                printf("parallel_find returned %d instead of %d\n", benchmark.index, positions[c]);
+            array[positions[c]] = HARD_SENTINEL;
+            bench_run(bench, &kernel, &result);
+            if (benchmark.index != positions[c])
+                printf("parallel_hard_find returned %d instead of %d\n", benchmark.index, positions[c]);
         }
 
-        time /= avg;
-        printf("BEST PARALLEL (%d thr): TIME = %lf\n", threads, time);
+        array[positions[c]] = saved;
+        printf("\n");
     }
+    release_predicate(&benchmark.hard);
     printf("\n");
+}
 
-    for (int threads = 2; threads <= omp_get_num_procs(); threads++) {
-        double time = 0.0, start, end;
-        for (int i = 0; i < avg; i++) {
-            int* array = array_creation(n, random_seed);
-            array[n - 1] = -1;
-            int target = -1;
-
-            start = omp_get_wtime();
-            parallel_max_find(n, threads, array, target);
-            end = omp_get_wtime();
-
-            time += end - start;
-            free(array);
-        }
 
-        time /= avg;
-        printf("WORST PARALLEL (%d thr): TIME = %lf\n", threads, time);
+/* Tune the claim size of the worst-case hard search for every thread count of the sweep */
+void autotune(int n, bench_config* bench, int* array){
+    search_benchmark benchmark = {n, 1, array, -1, -1,
+                                  make_power_predicate(power(HARD_SENTINEL, 50), 50, POWER_MODULUS),
+                                  SEARCH_FIRST, NULL, 0, -1};
+    const omp_sched_t kinds[] = {omp_sched_dynamic};     ///< Claims are dynamic whatever the kind says
+    int counts = omp_get_num_procs() > 1 ? omp_get_num_procs() - 1 : 1;
+    tuning_entry* best = (tuning_entry*) malloc(counts * sizeof(tuning_entry));
+    array[n - 1] = HARD_SENTINEL;
+    for (int c = 0; c < counts; c++) {
+        benchmark.threads = omp_get_num_procs() > 1 ? c + 2 : 1;
+        bench_kernel kernel = {"lab2/parallel_hard_find", data_distribution_name(DIST_RANDOM), n, benchmark.threads, 1,
+                               (double) n * sizeof(int), NULL, run_parallel_hard_find, &benchmark};
+        tuning_search(bench, &kernel, (n + CACHE_LINE_INTS - 1) / CACHE_LINE_INTS, kinds, 1, &best[c]);
     }
-    printf("\n\n");
+    tuning_profile_store(best, counts);
+    free(best);
+    release_predicate(&benchmark.hard);
 }
 
 
+/* Usage: lab2 [--bind=<policy>] [--places=<places>] [--autotune] */
 int main(int argc, char** argv)
 {
+    placement_configure(&argc, argv);
+
     /* Determine the OpenMP support */
     printf("OpenMP: %d\n", _OPENMP);
-    printf("threads_num: %d\n\n", omp_get_num_procs());
+    printf("threads_num: %d\n", omp_get_num_procs());
+    placement_report();
 
     const int elements[] = {200000000, 400000000, 600000000, 800000000, 1000000000};
-    const int avg = 10;                     ///< Number of calculations before
+    const int avg = 10;                     ///< Minimal number of timed repetitions
     const int random_seed = 920215;         ///< RNG seed
 
-    /* Initialize the RNG */
-    srand(random_seed);
+    bench_config bench;
+    bench_config_default(&bench);
+    bench.min_repetitions = avg;
+    bench_config_env(&bench);
+
+    if (argc > 1 && strcmp(argv[1], "--autotune") == 0) {
+        dataset input;
+        if (dataset_open(&input, DIST_RANDOM, elements[0], random_seed, 0) != 0)
+            return 1;
+        int* array = placement_copy_dataset(&input, omp_get_num_procs());
+        dataset_close(&input);
+        if (array == NULL)
+            return 1;
+        clear_hard_matches(array, elements[0]);
+        autotune(elements[0], &bench, array);
+        free(array);
+    } else if (tuning_apply("lab2/parallel_hard_find", elements[0], omp_get_num_procs())) {
+        printf("claim size: tuned profile %s, applied per thread count\n", tuning_profile_path());
+    }
+    printf("\n");
 
     for (int i = 0; i < 5; i++) {
         int n_array = elements[i];          ///< Number of array elements
         printf("Number of elements = %d\n", n_array);
+
+        /* A private, first-touched copy of the cached input takes the sentinels */
+        dataset input;
+        if (dataset_open(&input, DIST_RANDOM, n_array, random_seed, 0) != 0)
+            return 1;
+        int* array = placement_copy_dataset(&input, omp_get_num_procs());
+        dataset_close(&input);
+        if (array == NULL)
+            return 1;
+        placement_report_pages("input", array, (size_t) n_array * sizeof(int));
+        clear_hard_matches(array, n_array);
+
         /* Calculate sequential time */
-        sequential_calculations(n_array, avg, random_seed);
+        sequential_calculations(n_array, &bench, array);
 
         /* Calculate parallel time */
-        parallel_time(n_array, avg, random_seed);
+        parallel_time(n_array, &bench, array);
+        parallel_modes_time(n_array, &bench, array);
+
+        free(array);
     }
 
-    return 0;
+    return bench_finish(&bench) > 0;
 }
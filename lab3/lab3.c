@@ -1,40 +1,85 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
 #include <omp.h>
+#include "../common/dataset_cache.h"
+#include "../common/bench.h"
+#include "../common/tuning_profile.h"
+#include "../common/placement.h"
+
+#define MAX_GAPS 64
+#define CACHE_LINE_INTS 16
+#define RADIX_BITS 8
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+#define RADIX_PASSES (32 / RADIX_BITS)
+#define SAMPLE_OVERSAMPLING 32
+#define SAMPLE_BUCKETS_PER_THREAD 4
+#define ADAPTIVE_MIN_RUN 1024
+#define ADAPTIVE_MAX_RUNS 1024
+#define ADAPTIVE_SAMPLES 1024
+#define ADAPTIVE_FEW_VALUES 64          ///< At most this many distinct sampled values take the counting path
+#define ADAPTIVE_LOW_INVERSIONS 0.05    ///< Below this sampled inversion ratio, runs covering an eighth are merged
+
+
+typedef enum {
+    GAPS_SHELL,         ///< size/2, size/4, ..., 1
+    GAPS_CIURA,         ///< 1, 4, 10, 23, 57, 132, 301, 701, 1750, then * 2.25
+    GAPS_TOKUDA,        ///< ceil((9 * (9/4)^(k-1) - 4) / 5)
+    GAPS_SEDGEWICK,     ///< 1, then 4^k + 3 * 2^(k-1) + 1
+    GAPS_COUNT
+} gap_sequence;
+
+
+const char* gap_sequence_name(gap_sequence sequence) {
+    static const char* names[] = {"shell", "ciura", "tokuda", "sedgewick"};
+    return sequence < GAPS_COUNT ? names[sequence] : "unknown";
+}
 
 
+/* Fill `gaps` in decreasing order, every gap below size and the last one 1; returns the count */
+int build_gaps(gap_sequence sequence, int size, int *gaps) {
+    static const int ciura[] = {1, 4, 10, 23, 57, 132, 301, 701, 1750};
+    long long ascending[MAX_GAPS];
+    int count = 0;
 
-void traverse(int *array, int size, int gap, int start) {
-    for (int i = start + gap; i < size; i += gap){
-        int j = i;
-        int cur = array[i];
-        while (j >= gap && array[j - gap] > cur){
-            array[j] = array[j - gap];
-            j -= gap;
-        }
-        array[j] = cur;
+    if (sequence == GAPS_SHELL) {
+        for (int gap = size / 2; gap > 0 && count < MAX_GAPS; gap /= 2)
+            gaps[count++] = gap;
+        if (count == 0)
+            gaps[count++] = 1;
+        return count;
     }
-}
 
-
-void shell_sort_parallel(int *array, int size, int threads) {
-    int gap = size / 2;
-    while (gap > 0) {
-        #pragma omp parallel num_threads(threads) shared(array, size, gap) default(none)
-            {
-                #pragma omp for
-                for (int start = 0; start < gap; start++)
-                    traverse(array, size, gap, start);
-            }
-        gap /= 2;
+    for (int k = 0; count < MAX_GAPS; k++) {
+        long long gap;
+        if (sequence == GAPS_CIURA)
+            gap = k < 9 ? ciura[k] : (long long) (ascending[count - 1] * 2.25);
+        else if (sequence == GAPS_TOKUDA)
+            gap = (long long) ceil((9.0 * pow(2.25, k) - 4.0) / 5.0);
+        else
+            gap = k == 0 ? 1 : (1LL << (2 * k)) + 3 * (1LL << (k - 1)) + 1;
+        if (count > 0 && gap >= size)
+            break;
+        ascending[count++] = gap;
     }
+
+    for (int i = 0; i < count; i++)
+        gaps[i] = (int) ascending[count - 1 - i];
+    return count;
 }
 
 
-void shell_sort_sequential(int* array, int size) {
-    int gap = size / 2;
-    while (gap) {
-        for (int i = gap; i < size; i++) {
+/*
+ * gap-sort the chains [chain_begin, chain_end) row by row: consecutive
+ * elements of a row are adjacent in memory, and every move stays inside
+ * the band of columns, so threads with disjoint bands never share data.
+ */
+void h_sort_band(int *array, int size, int gap, int chain_begin, int chain_end) {
+    for (int row = gap; row < size; row += gap) {
+        int end = row + chain_end < size ? row + chain_end : size;
+        for (int i = row + chain_begin; i < end; i++) {
             int j = i;
             int cur = array[i];
             while (j >= gap && array[j - gap] > cur) {
@@ -43,128 +88,810 @@ void shell_sort_sequential(int* array, int size) {
             }
             array[j] = cur;
         }
-        gap /= 2;
     }
 }
 
 
-int* array_creation(int length, int random_seed){
-    int* array = (int*) calloc(length, sizeof(int));
+/* Number of elements of a that go before position `rank` of the merge of a and b */
+int co_rank(int rank, const int *a, int a_size, const int *b, int b_size) {
+    int low = rank > b_size ? rank - b_size : 0;
+    int high = rank < a_size ? rank : a_size;
+    while (low < high) {
+        int i = low + (high - low) / 2;
+        int j = rank - i;
+        if (j > 0 && i < a_size && b[j - 1] >= a[i])
+            low = i + 1;
+        else
+            high = i;
+    }
+    return low;
+}
 
-    for (int i = 0; i < length; i++)
-        (array)[i] = rand();
 
-    return array;
+/* Write positions [out_begin, out_end) of the stable merge of a and b into out */
+void merge_part(const int *a, int a_size, const int *b, int b_size, int *out, int out_begin, int out_end) {
+    int i = co_rank(out_begin, a, a_size, b, b_size);
+    int j = out_begin - i;
+    for (int k = out_begin; k < out_end; k++) {
+        if (j >= b_size || (i < a_size && a[i] <= b[j]))
+            out[k] = a[i++];
+        else
+            out[k] = b[j++];
+    }
 }
 
 
-int* create_reversed_array(int length, int random_seed) {
-    int* array = (int*) calloc(length, sizeof(int));
+/*
+ * Merge rounds over the sorted runs [bounds[r], bounds[r + 1]). Every thread
+ * produces an equal slice of the output, split between run pairs with
+ * co_rank, so the last rounds stay parallel. Must be called by the whole team.
+ */
+int *merge_runs(int *array, int *buffer, int size, const int *bounds, int runs) {
+    int *source = array, *target = buffer;
+    int thread = omp_get_thread_num();
+    int count = omp_get_num_threads();
+    int out_begin = (int) ((long long) size * thread / count);
+    int out_end = (int) ((long long) size * (thread + 1) / count);
+
+    for (int width = 1; width < runs; width *= 2) {
+        for (int left = 0; left < runs; left += 2 * width) {
+            int middle = left + width < runs ? left + width : runs;
+            int right = left + 2 * width < runs ? left + 2 * width : runs;
+            int pair_begin = bounds[left], pair_middle = bounds[middle], pair_end = bounds[right];
+            int begin = out_begin > pair_begin ? out_begin : pair_begin;
+            int end = out_end < pair_end ? out_end : pair_end;
+            if (begin < end)
+                merge_part(source + pair_begin, pair_middle - pair_begin, source + pair_middle, pair_end - pair_middle,
+                           target + pair_begin, begin - pair_begin, end - pair_begin);
+        }
+        int *swap = source;
+        source = target;
+        target = swap;
+        #pragma omp barrier
+    }
+    return source;
+}
 
-    for (int i = 0; i < length; i++)
-        array[i] = length - i;
 
-    return array;
+/*
+ * Scratch memory of the parallel sorts for inputs of up to `size` elements
+ * and teams of up to `threads`. It is allocated and first-touched once per
+ * input size, so the timed sorts see neither the allocation nor its page faults.
+ */
+typedef struct {
+    int size;
+    int threads;
+    int *buffer;                            ///< One element per input element
+    int (*radix_counts)[RADIX_BUCKETS];     ///< Digit histogram of every thread
+    int (*radix_lines)[CACHE_LINE_INTS];    ///< RADIX_BUCKETS staging lines per thread
+    int *samples;                           ///< Sample and splitters of the sample sort
+    int *bucket_counts;                     ///< Bucket histogram of every thread
+    int *bucket_begin;
+} sort_scratch;
+
+
+int sort_scratch_init(sort_scratch *scratch, int size, int threads) {
+    int buckets = threads * SAMPLE_BUCKETS_PER_THREAD;
+    scratch->size = size;
+    scratch->threads = threads;
+    scratch->buffer = placement_alloc_ints(size, threads);
+    scratch->radix_counts = malloc(threads * sizeof(*scratch->radix_counts));
+    scratch->radix_lines = aligned_alloc(64, (size_t) threads * RADIX_BUCKETS * sizeof(*scratch->radix_lines));
+    scratch->samples = (int *) malloc(buckets * SAMPLE_OVERSAMPLING * sizeof(int));
+    scratch->bucket_counts = (int *) malloc((long long) threads * buckets * sizeof(int));
+    scratch->bucket_begin = (int *) malloc((buckets + 1) * sizeof(int));
+    return scratch->buffer != NULL && scratch->radix_counts != NULL && scratch->radix_lines != NULL &&
+           scratch->samples != NULL && scratch->bucket_counts != NULL && scratch->bucket_begin != NULL ? 0 : -1;
 }
 
 
-int* create_partially_sorted_array(int length, int random_seed) {
-    int* array = (int*) calloc(length, sizeof(int));
-    int left = length / 4;
-    int right = length - left;
+void sort_scratch_free(sort_scratch *scratch) {
+    free(scratch->buffer);
+    free(scratch->radix_counts);
+    free(scratch->radix_lines);
+    free(scratch->samples);
+    free(scratch->bucket_counts);
+    free(scratch->bucket_begin);
+}
+
 
-    for (int i = 0; i < left; i++) {
-        array[i] = rand();
-        array[length - 1 - i] = rand();
+void shell_sort_parallel(int *array, int size, int threads, gap_sequence sequence, sort_scratch *scratch) {
+    int gaps[MAX_GAPS];
+    int gap_count = build_gaps(sequence, size, gaps);
+    int *buffer = scratch->buffer;
+    int bounds[threads + 1];
+
+    #pragma omp parallel num_threads(threads) shared(array, buffer, size, gaps, gap_count, bounds) default(none)
+    {
+        int thread = omp_get_thread_num();
+        int count = omp_get_num_threads();
+        int g = 0;
+
+        /*
+         * Large gaps: one global pass per gap over bands of a cache line of
+         * chains, dealt out by the omp_set_schedule schedule. Static hands
+         * every thread one contiguous run of bands.
+         */
+        for (; g < gap_count && gaps[g] >= count * CACHE_LINE_INTS; g++) {
+            int gap = gaps[g];
+            int bands = (gap + CACHE_LINE_INTS - 1) / CACHE_LINE_INTS;
+            #pragma omp for schedule(runtime)
+            for (int band = 0; band < bands; band++) {
+                int chain_end = (band + 1) * CACHE_LINE_INTS < gap ? (band + 1) * CACHE_LINE_INTS : gap;
+                h_sort_band(array, size, gap, band * CACHE_LINE_INTS, chain_end);
+            }
+        }
+
+        /* Small gaps: each thread finishes its own contiguous block, then the blocks are merged */
+        int block_begin = (int) ((long long) size * thread / count) / CACHE_LINE_INTS * CACHE_LINE_INTS;
+        int block_end = thread == count - 1 ? size
+                        : (int) ((long long) size * (thread + 1) / count) / CACHE_LINE_INTS * CACHE_LINE_INTS;
+        int block_size = block_end - block_begin;
+        bounds[thread] = block_begin;
+        if (thread == count - 1)
+            bounds[count] = size;
+
+        for (int k = g; k < gap_count; k++)
+            if (gaps[k] < block_size)
+                h_sort_band(array + block_begin, block_size, gaps[k], 0, gaps[k]);
+        #pragma omp barrier
+
+        int *sorted = merge_runs(array, buffer, size, bounds, count);
+        if (sorted != array) {
+            #pragma omp for schedule(static)
+            for (int i = 0; i < size; i++)
+                array[i] = sorted[i];
+        }
     }
-    for (int i = left; i < right; i++)
-        array[i] = i;
+}
+
 
-    return array;
+void shell_sort_sequential(int* array, int size, gap_sequence sequence) {
+    int gaps[MAX_GAPS];
+    int gap_count = build_gaps(sequence, size, gaps);
+    for (int g = 0; g < gap_count; g++)
+        h_sort_band(array, size, gaps[g], 0, gaps[g]);
 }
 
 
-void timing_sequential(int avg, int size, int random_seed) {
-    int *array;
-    for (int i = 0; i < 3; i++) {
-        double time = 0.0;
-        for (int j = 0; j < avg; j++) {
-            if (i == 0)
-                array = array_creation(size, random_seed);
-            else if (i == 1)
-                array = create_reversed_array(size, random_seed);
-            else
-                array = create_partially_sorted_array(size, random_seed);
+/* Flipping the sign bit makes the unsigned order of the keys match the signed order of the values */
+static inline unsigned radix_digit(int value, int pass) {
+    return (((unsigned) value ^ 0x80000000u) >> (pass * RADIX_BITS)) & (RADIX_BUCKETS - 1);
+}
+
+
+/*
+ * LSD radix sort, 8 bits per pass. Every thread keeps the histogram of its
+ * own block, so the scatter offsets come from one prefix sum over
+ * digit-major, thread-minor counts and no atomics are needed. Scattered keys
+ * are staged in a cache line per digit and written out a full line at a
+ * time. Passes whose digit is the same for every key are skipped.
+ */
+void radix_sort_parallel(int *array, int size, int threads, sort_scratch *scratch) {
+    int (*counts)[RADIX_BUCKETS] = scratch->radix_counts;
+    int (*staging)[CACHE_LINE_INTS] = scratch->radix_lines;
+    int *source = array, *target = scratch->buffer;
+    int skip = 0;
+
+    #pragma omp parallel num_threads(threads) shared(array, size, counts, staging, source, target, skip) default(none)
+    {
+        int thread = omp_get_thread_num();
+        int count = omp_get_num_threads();
+        int begin = (int) ((long long) size * thread / count);
+        int end = (int) ((long long) size * (thread + 1) / count);
+        int (*lines)[CACHE_LINE_INTS] = staging + thread * RADIX_BUCKETS;
+        int fill[RADIX_BUCKETS];
+        int offset[RADIX_BUCKETS];
+
+        for (int pass = 0; pass < RADIX_PASSES; pass++) {
+            memset(counts[thread], 0, sizeof(counts[thread]));
+            for (int i = begin; i < end; i++)
+                counts[thread][radix_digit(source[i], pass)]++;
+            #pragma omp barrier
+
+            #pragma omp single
+            {
+                int running = 0;
+                skip = 0;
+                for (int d = 0; d < RADIX_BUCKETS; d++) {
+                    int digit_begin = running;
+                    for (int t = 0; t < count; t++) {
+                        int c = counts[t][d];
+                        counts[t][d] = running;
+                        running += c;
+                    }
+                    if (running - digit_begin == size)
+                        skip = 1;
+                }
+            }
 
-            double start = omp_get_wtime();
-            shell_sort_sequential(array, size);
-            double end = omp_get_wtime();
+            if (!skip) {
+                memcpy(offset, counts[thread], sizeof(offset));
+                memset(fill, 0, sizeof(fill));
+                for (int i = begin; i < end; i++) {
+                    int value = source[i];
+                    unsigned d = radix_digit(value, pass);
+                    lines[d][fill[d]++] = value;
+                    if (fill[d] == CACHE_LINE_INTS) {
+                        memcpy(target + offset[d], lines[d], sizeof(lines[d]));
+                        offset[d] += CACHE_LINE_INTS;
+                        fill[d] = 0;
+                    }
+                }
+                for (int d = 0; d < RADIX_BUCKETS; d++)
+                    memcpy(target + offset[d], lines[d], fill[d] * sizeof(int));
+            }
+            #pragma omp barrier
 
-            time += end - start;
-            free(array);
+            #pragma omp single
+            if (!skip) {
+                int *swap = source;
+                source = target;
+                target = swap;
+            }
         }
 
-        if (i == 0)
-            printf("[RANDOM] ");
-        else if (i == 1)
-            printf("[REVERSED] ");
+        if (source != array) {
+            #pragma omp for schedule(static)
+            for (int i = 0; i < size; i++)
+                array[i] = source[i];
+        }
+    }
+}
+
+
+int compare_ints(const void *a, const void *b) {
+    int x = *(const int *) a, y = *(const int *) b;
+    return (x > y) - (x < y);
+}
+
+
+/* Index of the first splitter greater than value, i.e. the bucket the value belongs to */
+static inline int sample_bucket(int value, const int *splitters, int splitter_count) {
+    int low = 0, high = splitter_count;
+    while (low < high) {
+        int middle = (low + high) / 2;
+        if (splitters[middle] <= value)
+            low = middle + 1;
         else
-            printf("[PARTIALLY SORTED] ");
+            high = middle;
+    }
+    return low;
+}
+
+
+/*
+ * Sample sort for comparison-only keys: splitters are picked from an
+ * oversampled random sample, every thread distributes its block into the
+ * buckets, and the buckets are sorted independently. There are a few
+ * buckets per thread so that dynamic scheduling evens out uneven buckets.
+ */
+void sample_sort_parallel(int *array, int size, int threads, sort_scratch *scratch) {
+    int buckets = threads * SAMPLE_BUCKETS_PER_THREAD;
+    int sample_size = buckets * SAMPLE_OVERSAMPLING;
+    if (size < sample_size * 4) {
+        qsort(array, size, sizeof(int), compare_ints);
+        return;
+    }
+
+    int *buffer = scratch->buffer;
+    int *samples = scratch->samples;
+    int *counts = scratch->bucket_counts;
+    int *bucket_begin = scratch->bucket_begin;
+    int splitter_count = buckets - 1;
+
+    for (int i = 0; i < sample_size; i++)
+        samples[i] = array[random_at(920215, i) % (uint64_t) size];
+    qsort(samples, sample_size, sizeof(int), compare_ints);
+    for (int b = 0; b < splitter_count; b++)
+        samples[b] = samples[(b + 1) * SAMPLE_OVERSAMPLING];
+    const int *splitters = samples;
+
+    #pragma omp parallel num_threads(threads) \
+            shared(array, buffer, size, buckets, splitters, splitter_count, counts, bucket_begin) default(none)
+    {
+        int thread = omp_get_thread_num();
+        int count = omp_get_num_threads();
+        int begin = (int) ((long long) size * thread / count);
+        int end = (int) ((long long) size * (thread + 1) / count);
+        int *local = counts + (long long) thread * buckets;
+
+        memset(local, 0, buckets * sizeof(int));
+        for (int i = begin; i < end; i++)
+            local[sample_bucket(array[i], splitters, splitter_count)]++;
+        #pragma omp barrier
+
+        #pragma omp single
+        {
+            int running = 0;
+            for (int b = 0; b < buckets; b++) {
+                bucket_begin[b] = running;
+                for (int t = 0; t < count; t++) {
+                    int c = counts[(long long) t * buckets + b];
+                    counts[(long long) t * buckets + b] = running;
+                    running += c;
+                }
+            }
+            bucket_begin[buckets] = running;
+        }
+
+        for (int i = begin; i < end; i++) {
+            int value = array[i];
+            buffer[local[sample_bucket(value, splitters, splitter_count)]++] = value;
+        }
+        #pragma omp barrier
+
+        #pragma omp for schedule(dynamic, 1)
+        for (int b = 0; b < buckets; b++) {
+            int bucket_size = bucket_begin[b + 1] - bucket_begin[b];
+            qsort(buffer + bucket_begin[b], bucket_size, sizeof(int), compare_ints);
+            memcpy(array + bucket_begin[b], buffer + bucket_begin[b], bucket_size * sizeof(int));
+        }
+    }
+}
+
 
-        printf("SEQUENTIAL: time = %f;\n", time / avg);
+typedef enum {
+    STRATEGY_SORTED,        ///< Nothing to do
+    STRATEGY_REVERSE,       ///< Non-increasing input, reversed in place
+    STRATEGY_FEW_VALUES,    ///< A handful of distinct values: count them and write the runs of equal keys
+    STRATEGY_RUN_MERGE,     ///< Long runs cover a third of the input, an eighth if it is nearly sorted
+    STRATEGY_GENERAL,       ///< Radix sort
+    STRATEGY_COUNT
+} sort_strategy;
+
+
+const char* sort_strategy_name(sort_strategy strategy) {
+    static const char* names[] = {"sorted", "reverse", "few_values", "run_merge", "general"};
+    return strategy < STRATEGY_COUNT ? names[strategy] : "unknown";
+}
+
+
+typedef struct {
+    long long descents;         ///< Positions with array[i] > array[i + 1]
+    long long ascents;          ///< Positions with array[i] < array[i + 1]
+    double inversion_ratio;     ///< Share of sampled pairs i < j with array[i] > array[j]
+    int distinct;               ///< Distinct values among ADAPTIVE_SAMPLES sampled elements
+    int values[ADAPTIVE_FEW_VALUES];    ///< Those values in ascending order, if there are few enough
+    long long run_coverage;     ///< Elements inside non-decreasing runs of at least ADAPTIVE_MIN_RUN
+    int runs;                   ///< Number of such runs, -1 if there were too many to keep
+    int run_begin[ADAPTIVE_MAX_RUNS];
+    int run_end[ADAPTIVE_MAX_RUNS];
+} sort_profile;
+
+
+/*
+ * One parallel read of the input plus a small random sample. Every thread
+ * scans its own block, so a run crossing a block boundary is recorded as
+ * two runs; the dispatcher joins them back if they line up.
+ */
+void profile_input(const int *array, int size, int threads, sort_profile *profile) {
+    long long descents = 0, ascents = 0, coverage = 0;
+    int per_thread = ADAPTIVE_MAX_RUNS / threads;
+    int run_counts[threads];
+    int team = threads;
+
+    #pragma omp parallel num_threads(threads) shared(array, size, profile, per_thread, run_counts, team) \
+            reduction(+: descents, ascents, coverage) default(none)
+    {
+        int thread = omp_get_thread_num();
+        int count = omp_get_num_threads();
+        if (thread == 0)
+            team = count;
+        int begin = (int) ((long long) size * thread / count);
+        int end = (int) ((long long) size * (thread + 1) / count);
+        int *run_begin = profile->run_begin + thread * per_thread;
+        int *run_end = profile->run_end + thread * per_thread;
+        int runs = 0, start = begin;
+
+        for (int i = begin; i < end; i++) {
+            int next = i + 1 < size ? array[i + 1] : array[i];
+            descents += array[i] > next;
+            ascents += array[i] < next;
+            if (i + 1 == end || array[i] > next) {
+                if (i + 1 - start >= ADAPTIVE_MIN_RUN) {
+                    coverage += i + 1 - start;
+                    if (runs < per_thread) {
+                        run_begin[runs] = start;
+                        run_end[runs] = i + 1;
+                    }
+                    runs++;
+                }
+                start = i + 1;
+            }
+        }
+        run_counts[thread] = runs;
+    }
+
+    profile->descents = descents;
+    profile->ascents = ascents;
+    profile->run_coverage = coverage;
+    profile->runs = 0;
+    for (int t = 0; t < team && profile->runs >= 0; t++) {
+        if (run_counts[t] > per_thread) {
+            profile->runs = -1;
+            break;
+        }
+        memmove(profile->run_begin + profile->runs, profile->run_begin + t * per_thread, run_counts[t] * sizeof(int));
+        memmove(profile->run_end + profile->runs, profile->run_end + t * per_thread, run_counts[t] * sizeof(int));
+        profile->runs += run_counts[t];
+    }
+
+    int samples[ADAPTIVE_SAMPLES];
+    int inversions = 0;
+    for (int k = 0; k < ADAPTIVE_SAMPLES; k++) {
+        int i = (int) (random_at(920215, 2 * k) % (uint64_t) size);
+        int j = (int) (random_at(920215, 2 * k + 1) % (uint64_t) size);
+        if (i > j) {
+            int swap = i;
+            i = j;
+            j = swap;
+        }
+        inversions += array[i] > array[j];
+        samples[k] = array[i];
+    }
+    qsort(samples, ADAPTIVE_SAMPLES, sizeof(int), compare_ints);
+    profile->distinct = 0;
+    for (int k = 0; k < ADAPTIVE_SAMPLES; k++)
+        if (k == 0 || samples[k] != samples[k - 1]) {
+            if (profile->distinct < ADAPTIVE_FEW_VALUES)
+                profile->values[profile->distinct] = samples[k];
+            profile->distinct++;
+        }
+    profile->inversion_ratio = (double) inversions / ADAPTIVE_SAMPLES;
+}
+
+
+sort_strategy choose_strategy(const sort_profile *profile, int size) {
+    if (profile->descents == 0)
+        return STRATEGY_SORTED;
+    if (profile->ascents == 0)
+        return STRATEGY_REVERSE;
+    if (profile->distinct <= ADAPTIVE_FEW_VALUES)
+        return STRATEGY_FEW_VALUES;
+    if (profile->runs > 0 && (profile->run_coverage * 3 >= size ||
+                              (profile->inversion_ratio < ADAPTIVE_LOW_INVERSIONS && profile->run_coverage * 8 >= size)))
+        return STRATEGY_RUN_MERGE;
+    return STRATEGY_GENERAL;
+}
+
+
+void reverse_parallel(int *array, int size, int threads) {
+    #pragma omp parallel for num_threads(threads) schedule(static) shared(array, size) default(none)
+    for (int i = 0; i < size / 2; i++) {
+        int swap = array[i];
+        array[i] = array[size - 1 - i];
+        array[size - 1 - i] = swap;
+    }
+}
+
+
+/*
+ * The sampled values are taken as the only keys: every thread counts the
+ * keys of its block, and then writes its slice of the output as runs of
+ * equal keys, so the input is read once and nothing is scattered. Returns
+ * -1 with the array untouched if an element turns out not to be a key.
+ */
+int few_values_sort_parallel(int *array, int size, int threads, const sort_profile *profile) {
+    int keys = profile->distinct;
+    long long counts[threads][ADAPTIVE_FEW_VALUES];
+    long long starts[ADAPTIVE_FEW_VALUES + 1];
+    int missing = 0;
+
+    #pragma omp parallel num_threads(threads) shared(array, size, profile, keys, counts, starts, missing) default(none)
+    {
+        int thread = omp_get_thread_num();
+        int count = omp_get_num_threads();
+        int begin = (int) ((long long) size * thread / count);
+        int end = (int) ((long long) size * (thread + 1) / count);
+        long long local[ADAPTIVE_FEW_VALUES] = {0};
+
+        for (int i = begin; i < end; i++) {
+            int key = sample_bucket(array[i], profile->values, keys) - 1;
+            if (key < 0 || profile->values[key] != array[i]) {
+                #pragma omp atomic write
+                missing = 1;
+                break;
+            }
+            local[key]++;
+        }
+        memcpy(counts[thread], local, sizeof(local));
+        #pragma omp barrier
+
+        #pragma omp single
+        {
+            starts[0] = 0;
+            for (int k = 0; k < keys; k++) {
+                starts[k + 1] = starts[k];
+                for (int t = 0; t < count; t++)
+                    starts[k + 1] += counts[t][k];
+            }
+        }
+
+        if (!missing)
+            for (int k = 0; k < keys; k++) {
+                long long from = starts[k] > begin ? starts[k] : begin;
+                long long to = starts[k + 1] < end ? starts[k + 1] : end;
+                for (long long i = from; i < to; i++)
+                    array[i] = profile->values[k];
+            }
+    }
+    return missing ? -1 : 0;
+}
+
+
+/* Sort the gaps between the profiled runs, then merge runs and gaps as sorted sequences */
+void run_merge_parallel(int *array, int size, int threads, const sort_profile *profile, sort_scratch *scratch) {
+    int *bounds = (int *) malloc((2 * profile->runs + 2) * sizeof(int));
+    int count = 0, position = 0;
+
+    bounds[count++] = 0;
+    for (int r = 0; r < profile->runs; r++) {
+        int begin = profile->run_begin[r], end = profile->run_end[r];
+        if (begin > position) {
+            radix_sort_parallel(array + position, begin - position, threads, scratch);
+            bounds[count++] = begin;
+        } else if (position > 0 && array[position - 1] <= array[begin]) {
+            count--;
+        }
+        bounds[count++] = end;
+        position = end;
+    }
+    if (position < size) {
+        radix_sort_parallel(array + position, size - position, threads, scratch);
+        bounds[count++] = size;
+    }
+
+    int runs = count - 1;
+    if (runs > 1) {
+        int *buffer = scratch->buffer;
+        #pragma omp parallel num_threads(threads) shared(array, buffer, size, bounds, runs) default(none)
+        {
+            int *sorted = merge_runs(array, buffer, size, bounds, runs);
+            if (sorted != array) {
+                #pragma omp for schedule(static)
+                for (int i = 0; i < size; i++)
+                    array[i] = sorted[i];
+            }
+        }
+    }
+    free(bounds);
+}
+
+
+sort_strategy adaptive_sort_parallel(int *array, int size, int threads, sort_scratch *scratch) {
+    if (size < 2)
+        return STRATEGY_SORTED;
+
+    sort_profile profile;
+    profile_input(array, size, threads, &profile);
+    sort_strategy strategy = choose_strategy(&profile, size);
+    switch (strategy) {
+        case STRATEGY_REVERSE:
+            reverse_parallel(array, size, threads);
+            break;
+        case STRATEGY_FEW_VALUES:
+            if (few_values_sort_parallel(array, size, threads, &profile) == 0)
+                break;
+            strategy = STRATEGY_GENERAL;
+            radix_sort_parallel(array, size, threads, scratch);
+            break;
+        case STRATEGY_RUN_MERGE:
+            run_merge_parallel(array, size, threads, &profile, scratch);
+            break;
+        case STRATEGY_GENERAL:
+            radix_sort_parallel(array, size, threads, scratch);
+            break;
+        default:
+            break;
+    }
+    return strategy;
+}
+
+
+const data_distribution timing_distributions[] = {DIST_RANDOM, DIST_REVERSED, DIST_PARTIALLY_SORTED, DIST_FEW_UNIQUE};
+const int timing_cases = sizeof(timing_distributions) / sizeof(timing_distributions[0]);
+
+
+typedef struct {
+    const dataset* input;
+    int* array;
+    int size;
+    int threads;
+    gap_sequence sequence;
+    sort_scratch *scratch;      ///< Shared by the parallel sorts, NULL for the sequential one
+} sort_benchmark;
+
+
+void restore_input(void* ctx) {
+    sort_benchmark* benchmark = (sort_benchmark*) ctx;
+    dataset_copy(benchmark->input, benchmark->array);
+}
+
+
+void run_shell_sort_sequential(void* ctx) {
+    sort_benchmark* benchmark = (sort_benchmark*) ctx;
+    shell_sort_sequential(benchmark->array, benchmark->size, benchmark->sequence);
+}
+
+
+void run_shell_sort_parallel(void* ctx) {
+    sort_benchmark* benchmark = (sort_benchmark*) ctx;
+    shell_sort_parallel(benchmark->array, benchmark->size, benchmark->threads, benchmark->sequence, benchmark->scratch);
+}
+
+
+void run_radix_sort_parallel(void* ctx) {
+    sort_benchmark* benchmark = (sort_benchmark*) ctx;
+    radix_sort_parallel(benchmark->array, benchmark->size, benchmark->threads, benchmark->scratch);
+}
+
+
+void run_sample_sort_parallel(void* ctx) {
+    sort_benchmark* benchmark = (sort_benchmark*) ctx;
+    sample_sort_parallel(benchmark->array, benchmark->size, benchmark->threads, benchmark->scratch);
+}
+
+
+void run_adaptive_sort_parallel(void* ctx) {
+    sort_benchmark* benchmark = (sort_benchmark*) ctx;
+    adaptive_sort_parallel(benchmark->array, benchmark->size, benchmark->threads, benchmark->scratch);
+}
+
+
+typedef struct {
+    const char* name;
+    void (*run)(void* ctx);
+    int uses_gaps;
+} sort_engine;
+
+const sort_engine parallel_engines[] = {
+    {"shell_sort_parallel", run_shell_sort_parallel, 1},
+    {"radix_sort_parallel", run_radix_sort_parallel, 0},
+    {"sample_sort_parallel", run_sample_sort_parallel, 0},
+    {"adaptive_sort_parallel", run_adaptive_sort_parallel, 0},
+};
+const int parallel_engines_count = sizeof(parallel_engines) / sizeof(parallel_engines[0]);
+
+
+void timing_sequential(bench_config* bench, int size, int random_seed, gap_sequence sequence) {
+    sort_benchmark benchmark = {NULL, placement_alloc_ints(size, 1), size, 1, sequence, NULL};
+    char name[BENCH_NAME_LENGTH];
+    snprintf(name, sizeof(name), "shell_sort_sequential/%s", gap_sequence_name(sequence));
+    for (int i = 0; i < timing_cases; i++) {
+        dataset input;
+        if (dataset_open(&input, timing_distributions[i], size, random_seed, 0) != 0)
+            break;
+
+        benchmark.input = &input;
+        bench_kernel kernel = {name, data_distribution_name(timing_distributions[i]), size, 1, 1,
+                               0.0, restore_input, run_shell_sort_sequential, &benchmark};
+        bench_result result;
+        bench_run(bench, &kernel, &result);
+        dataset_close(&input);
     }
     printf("\n");
+    free(benchmark.array);
 }
 
 
-void timing_parallel(int avg, int size, int min_threads, int random_seed) {
-    int *array;
+void timing_parallel(bench_config* bench, int size, int min_threads, int random_seed, gap_sequence sequence) {
+    sort_scratch scratch;
+    sort_benchmark benchmark = {NULL, placement_alloc_ints(size, omp_get_num_procs()), size, 1, sequence, &scratch};
+    dataset inputs[sizeof(timing_distributions) / sizeof(timing_distributions[0])];
+    if (sort_scratch_init(&scratch, size, omp_get_num_procs()) != 0) {
+        sort_scratch_free(&scratch);
+        free(benchmark.array);
+        return;
+    }
+    for (int i = 0; i < timing_cases; i++)
+        if (dataset_open(&inputs[i], timing_distributions[i], size, random_seed, 0) != 0) {
+            while (i-- > 0)
+                dataset_close(&inputs[i]);
+            sort_scratch_free(&scratch);
+            free(benchmark.array);
+            return;
+        }
+
+    for (int i = 0; i < timing_cases; i++) {
+        sort_profile profile;
+        profile_input(inputs[i].data, size, omp_get_num_procs(), &profile);
+        printf("profile %s: descents=%lld ascents=%lld runs=%d coverage=%.2f inversions=%.3f distinct=%d/%d -> %s\n",
+               data_distribution_name(timing_distributions[i]), profile.descents, profile.ascents, profile.runs,
+               (double) profile.run_coverage / size, profile.inversion_ratio, profile.distinct, ADAPTIVE_SAMPLES,
+               sort_strategy_name(choose_strategy(&profile, size)));
+    }
+
     for (int threads = min_threads; threads <= omp_get_num_procs(); threads++) {
-        for (int i = 0; i < 3; i++) {
-            double time = 0.0;
-            for (int j = 0; j < avg; j++) {
-                if (i == 0)
-                    array = array_creation(size, random_seed);
-                else if (i == 1)
-                    array = create_reversed_array(size, random_seed);
-                else
-                    array = create_partially_sorted_array(size, random_seed);
-
-                double start = omp_get_wtime();
-                shell_sort_parallel(array, size, threads);
-                double end = omp_get_wtime();
-
-                time += end - start;
-                free(array);
-            }
-            if (i == 0)
-                printf("[RANDOM] ");
-            else if (i == 1)
-                printf("[REVERSED] ");
+        tuning_apply("lab3/shell_sort_parallel", size, threads);
+        for (int e = 0; e < parallel_engines_count; e++) {
+            char name[BENCH_NAME_LENGTH];
+            if (parallel_engines[e].uses_gaps)
+                snprintf(name, sizeof(name), "%s/%s", parallel_engines[e].name, gap_sequence_name(sequence));
             else
-                printf("[PARTIALLY SORTED] ");
-
-            printf("PARALLEL (%d thr): time = %f;\n", threads, time / avg);
+                snprintf(name, sizeof(name), "%s", parallel_engines[e].name);
+
+            for (int i = 0; i < timing_cases; i++) {
+                benchmark.input = &inputs[i];
+                benchmark.threads = threads;
+                bench_kernel kernel = {name, data_distribution_name(timing_distributions[i]), size,
+                                       threads, 1, 0.0, restore_input, parallel_engines[e].run, &benchmark};
+                bench_result result;
+                bench_run(bench, &kernel, &result);
+            }
         }
         printf("\n");
     }
+
+    for (int i = 0; i < timing_cases; i++)
+        dataset_close(&inputs[i]);
+    sort_scratch_free(&scratch);
+    free(benchmark.array);
+}
+
+
+/* Tune the schedule of the large-gap passes on random input for every thread count of the sweep */
+void autotune(bench_config* bench, int size, int random_seed, gap_sequence sequence) {
+    sort_scratch scratch;
+    sort_benchmark benchmark = {NULL, placement_alloc_ints(size, omp_get_num_procs()), size, omp_get_num_procs(), sequence,
+                                &scratch};
+    dataset input;
+    if (sort_scratch_init(&scratch, size, omp_get_num_procs()) == 0 &&
+        dataset_open(&input, DIST_RANDOM, size, random_seed, 0) == 0) {
+        int counts = omp_get_num_procs() > 1 ? omp_get_num_procs() - 1 : 1;
+        tuning_entry* best = (tuning_entry*) malloc(counts * sizeof(tuning_entry));
+        benchmark.input = &input;
+        for (int c = 0; c < counts; c++) {
+            benchmark.threads = omp_get_num_procs() > 1 ? c + 2 : 1;
+            bench_kernel kernel = {"lab3/shell_sort_parallel", data_distribution_name(DIST_RANDOM), size,
+                                   benchmark.threads, 1, 0.0, restore_input, run_shell_sort_parallel, &benchmark};
+            tuning_search(bench, &kernel, size / CACHE_LINE_INTS, NULL, 0, &best[c]);
+        }
+        tuning_profile_store(best, counts);
+        free(best);
+        dataset_close(&input);
+    }
+    sort_scratch_free(&scratch);
+    free(benchmark.array);
 }
 
 
-int main(){
+/* Usage: lab3 [shell|ciura|tokuda|sedgewick] [--autotune] [--bind=<policy>] [--places=<places>], Ciura's gaps by default */
+int main(int argc, char** argv){
+    placement_configure(&argc, argv);
+    gap_sequence sequence = GAPS_CIURA;
+    int tune = 0;
+    for (int a = 1; a < argc; a++) {
+        tune |= strcmp(argv[a], "--autotune") == 0;
+        for (int s = 0; s < GAPS_COUNT; s++)
+            if (strcmp(argv[a], gap_sequence_name(s)) == 0)
+                sequence = s;
+    }
+
     printf("OpenMP: %d\n", _OPENMP);
     printf("threads: %d\n", omp_get_num_procs());
+    printf("gaps: %s\n", gap_sequence_name(sequence));
+    placement_report();
 
     int sizes[] = {1000000, 2500000, 5000000, 7500000, 10000000};
     const int repetitions_number = 10;
     const int random_seed = 920215;
-    srand(random_seed);
 
-    for (int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    bench_config bench;
+    bench_config_default(&bench);
+    bench.min_repetitions = repetitions_number;
+    bench_config_env(&bench);
+
+    if (tune)
+        autotune(&bench, sizes[0], random_seed, sequence);
+    else if (tuning_apply("lab3/shell_sort_parallel", sizes[0], omp_get_num_procs()))
+        printf("schedule: tuned profile %s, applied per thread count\n", tuning_profile_path());
+
+    for (int i = 0; i < (int) (sizeof(sizes) / sizeof(sizes[0])); i++) {
         int size = sizes[i];
         printf("\n\nTIME MEASUREMENT (%d elements)\n", size);
-        timing_sequential(repetitions_number, size, random_seed);
-        timing_parallel(repetitions_number, size, 2, random_seed);
+        timing_sequential(&bench, size, random_seed, sequence);
+        timing_parallel(&bench, size, 2, random_seed, sequence);
     }
-    return 0;
+    return bench_finish(&bench) > 0;
 }
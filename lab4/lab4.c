@@ -1,6 +1,28 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdatomic.h>
 #include <omp.h>
+#include "../common/dataset_cache.h"
+#include "../common/bench.h"
+#include "../common/work_stealing.h"
+#include "../common/tuning_profile.h"
+#include "../common/locks.h"
+#include "../common/placement.h"
+
+#define CACHE_LINE 64
+#define POWER_MAX_ROUNDS 4096
+#define POWER_MODULUS 131
+#define SYNC_OPERATIONS 10000
+
+typedef struct {
+    _Alignas(CACHE_LINE) int value;     ///< One per thread, alone on its cache line
+} padded_int;
+
+typedef struct {
+    const char *name;
+    omp_sched_t kind;
+} schedule_policy;
 
 void get_schedule_info(int *schedule, int *chunk_size) {
     omp_sched_t kind;
@@ -25,84 +47,257 @@ void get_schedule_info(int *schedule, int *chunk_size) {
     }
 }
 
-int function_with_locks(int n, int *unique_values) {
-    omp_lock_t lock;
-    omp_init_lock(&lock);
+typedef enum {
+    SYNC_OMP_LOCK,
+    SYNC_OMP_NEST_LOCK,
+    SYNC_CRITICAL,
+    SYNC_ATOMIC,            ///< The counter update only, the critical-section work is skipped
+    SYNC_TTAS,
+    SYNC_TICKET,
+    SYNC_MCS,
+    SYNC_COUNT
+} sync_kind;
 
-    int sum = 0;
-    int unique_count = 0;
+const char *sync_kind_name(sync_kind kind) {
+    static const char *names[] = {"omp_lock", "omp_nest_lock", "critical", "atomic", "ttas", "ticket", "mcs"};
+    return kind < SYNC_COUNT ? names[kind] : "unknown";
+}
 
-    for (int i = 0; i < n; i++) {
-#pragma omp parallel
-        {
-            int thread_num = omp_get_thread_num();
-            omp_set_lock(&lock);
-            sum += thread_num;
-            omp_unset_lock(&lock);
-        }
+typedef struct {
+    _Alignas(CACHE_LINE) long long value;
+} padded_counter;
 
-#pragma omp parallel
-        {
-            int thread_num = omp_get_thread_num();
-            sum -= thread_num;
-        }
+/*
+ * Every thread takes the lock `operations` times. Inside it bumps the
+ * shared counter and runs `cs_length` steps of work on shared data; after
+ * the release it bumps its own statistics counter, either packed next to
+ * the other threads' counters or alone on a cache line.
+ */
+typedef struct {
+    sync_kind kind;
+    int threads;
+    int operations;
+    int cs_length;
+    int false_sharing;
+    omp_lock_t omp_lock;
+    omp_nest_lock_t nest_lock;
+    ttas_lock ttas;
+    ticket_lock ticket;
+    mcs_lock mcs;
+    long long counter;
+    volatile unsigned long long protected_data;
+    long long *packed;
+    padded_counter *padded;
+    double *latencies;              ///< Acquire-to-release time of every operation of the last run
+} sync_benchmark;
+
+static inline void critical_work(sync_benchmark *benchmark) {
+    benchmark->counter++;
+    for (int w = 0; w < benchmark->cs_length; w++)
+        benchmark->protected_data = benchmark->protected_data * 31 + w;
+}
 
-        int is_unique = 1;
-        for (int j = 0; j < unique_count; j++) {
-            if (unique_values[j] == sum) {
-                is_unique = 0;
-                break;
+void reset_sync(void *ctx) {
+    sync_benchmark *benchmark = (sync_benchmark *)ctx;
+    benchmark->counter = 0;
+    for (int t = 0; t < benchmark->threads; t++) {
+        benchmark->packed[t] = 0;
+        benchmark->padded[t].value = 0;
+    }
+}
+
+void run_sync(void *ctx) {
+    sync_benchmark *benchmark = (sync_benchmark *)ctx;
+
+#pragma omp parallel num_threads(benchmark->threads)
+    {
+        int thread = omp_get_thread_num();
+        double *latencies = benchmark->latencies + (long long)thread * benchmark->operations;
+
+        for (int op = 0; op < benchmark->operations; op++) {
+            double start = bench_now();
+            switch (benchmark->kind) {
+                case SYNC_OMP_LOCK:
+                    omp_set_lock(&benchmark->omp_lock);
+                    critical_work(benchmark);
+                    omp_unset_lock(&benchmark->omp_lock);
+                    break;
+                case SYNC_OMP_NEST_LOCK:
+                    omp_set_nest_lock(&benchmark->nest_lock);
+                    critical_work(benchmark);
+                    omp_unset_nest_lock(&benchmark->nest_lock);
+                    break;
+                case SYNC_CRITICAL:
+#pragma omp critical(sync_benchmark)
+                    critical_work(benchmark);
+                    break;
+                case SYNC_ATOMIC:
+#pragma omp atomic
+                    benchmark->counter++;
+                    break;
+                case SYNC_TTAS:
+                    ttas_acquire(&benchmark->ttas);
+                    critical_work(benchmark);
+                    ttas_release(&benchmark->ttas);
+                    break;
+                case SYNC_TICKET:
+                    ticket_acquire(&benchmark->ticket);
+                    critical_work(benchmark);
+                    ticket_release(&benchmark->ticket);
+                    break;
+                case SYNC_MCS:
+                default: {
+                    mcs_node node;
+                    mcs_acquire(&benchmark->mcs, &node);
+                    critical_work(benchmark);
+                    mcs_release(&benchmark->mcs, &node);
+                    break;
+                }
             }
+            latencies[op] = bench_now() - start;
+
+            if (benchmark->false_sharing)
+                benchmark->packed[thread]++;
+            else
+                benchmark->padded[thread].value++;
         }
+    }
+}
+
+/* Throughput and latency percentiles of every primitive for 1, 2, 4, ... and all threads */
+void sync_suite(bench_config *bench, const int *cs_lengths, int cs_count, int operations) {
+    int max_threads = omp_get_num_procs();
+    sync_benchmark benchmark;
+    memset(&benchmark, 0, sizeof(benchmark));
+    benchmark.operations = operations;
+    benchmark.packed = (long long *)calloc(max_threads, sizeof(long long));
+    benchmark.padded = (padded_counter *)aligned_alloc(CACHE_LINE, max_threads * sizeof(padded_counter));
+    benchmark.latencies = (double *)malloc((long long)max_threads * operations * sizeof(double));
+    omp_init_lock(&benchmark.omp_lock);
+    omp_init_nest_lock(&benchmark.nest_lock);
+    ttas_init(&benchmark.ttas);
+    ticket_init(&benchmark.ticket);
+    mcs_init(&benchmark.mcs);
 
-        if (is_unique) {
-            unique_values[unique_count] = sum;
-            unique_count++;
+    for (int step = 1; step < 2 * max_threads; step *= 2) {
+        int threads = step < max_threads ? step : max_threads;
+        for (int kind = 0; kind < SYNC_COUNT; kind++) {
+            for (int c = 0; c < cs_count; c++) {
+                if (kind == SYNC_ATOMIC && c > 0)
+                    continue;
+                for (int false_sharing = 0; false_sharing <= 1; false_sharing++) {
+                    char name[BENCH_NAME_LENGTH];
+                    snprintf(name, sizeof(name), "sync_%s/cs=%d/%s", sync_kind_name(kind),
+                             kind == SYNC_ATOMIC ? 0 : cs_lengths[c], false_sharing ? "packed" : "padded");
+                    benchmark.kind = kind;
+                    benchmark.threads = threads;
+                    benchmark.cs_length = cs_lengths[c];
+                    benchmark.false_sharing = false_sharing;
+                    bench_kernel kernel = {name, "contended", (long long)threads * operations, threads, 1, 0.0,
+                                           reset_sync, run_sync, &benchmark};
+                    bench_result result;
+                    bench_run(bench, &kernel, &result);
+
+                    long long total = (long long)threads * operations;
+                    qsort(benchmark.latencies, total, sizeof(double), bench_compare_doubles);
+                    printf("   %.2f Mops/s, latency p50=%.0f ns p99=%.0f ns max=%.0f ns%s\n",
+                           total / result.median * 1e-6, bench_percentile(benchmark.latencies, total, 0.50) * 1e9,
+                           bench_percentile(benchmark.latencies, total, 0.99) * 1e9,
+                           benchmark.latencies[total - 1] * 1e9,
+                           benchmark.counter == total ? "" : ", COUNTER MISMATCH");
+                }
+            }
         }
     }
-    omp_destroy_lock(&lock);
 
-    return unique_count;
+    omp_destroy_lock(&benchmark.omp_lock);
+    omp_destroy_nest_lock(&benchmark.nest_lock);
+    free(benchmark.latencies);
+    free(benchmark.padded);
+    free(benchmark.packed);
 }
 
-int find_max_static(const int *array, int n) {
+/*
+ * Every find_max_* below takes its loop schedule from omp_set_schedule
+ * (schedule(runtime)), so the same combiner can be timed under each policy.
+ * Threads reduce into a private maximum and combine once at the end.
+ */
+int find_max_reduction(const int *array, int n) {
     int max_value = array[0];
-#pragma omp parallel for schedule(static)
+#pragma omp parallel for schedule(runtime) reduction(max: max_value)
     for (int i = 1; i < n; i++)
-#pragma omp critical
-            if (array[i] > max_value)
-                max_value = array[i];
+        if (array[i] > max_value)
+            max_value = array[i];
     return max_value;
 }
 
-int find_max_dynamic(const int *array, int n) {
-    int max_value = array[0];
-#pragma omp parallel for schedule(dynamic)
-    for (int i = 1; i < n; i++)
-#pragma omp critical
-            if (array[i] > max_value)
-                max_value = array[i];
+int find_max_padded(const int *array, int n) {
+    int threads = omp_get_max_threads();
+    padded_int partials[threads];
+    for (int t = 0; t < threads; t++)
+        partials[t].value = array[0];
+
+#pragma omp parallel num_threads(threads)
+    {
+        int local = array[0];
+#pragma omp for schedule(runtime) nowait
+        for (int i = 1; i < n; i++)
+            if (array[i] > local)
+                local = array[i];
+        partials[omp_get_thread_num()].value = local;
+    }
+
+    int max_value = partials[0].value;
+    for (int t = 1; t < threads; t++)
+        if (partials[t].value > max_value)
+            max_value = partials[t].value;
     return max_value;
 }
 
-int find_max_guided(const int *array, int n) {
-    int max_value = array[0];
-#pragma omp parallel for schedule(guided)
-    for (int i = 1; i < n; i++)
-#pragma omp critical
-            if (array[i] > max_value)
-                max_value = array[i];
-    return max_value;
+int find_max_cas(const int *array, int n) {
+    atomic_int max_value = array[0];
+#pragma omp parallel
+    {
+        int local = array[0];
+#pragma omp for schedule(runtime) nowait
+        for (int i = 1; i < n; i++)
+            if (array[i] > local)
+                local = array[i];
+
+        int current = atomic_load_explicit(&max_value, memory_order_relaxed);
+        while (local > current &&
+               !atomic_compare_exchange_weak_explicit(&max_value, &current, local, memory_order_relaxed,
+                                                      memory_order_relaxed))
+            ;
+    }
+    return atomic_load(&max_value);
 }
 
-int find_max_auto(const int *array, int n) {
-    int max_value = array[0];
-#pragma omp parallel for schedule(auto)
-    for (int i = 1; i < n; i++)
-#pragma omp critical
-            if (array[i] > max_value)
-                max_value = array[i];
-    return max_value;
+/* Pairwise combine in log2(threads) rounds, each thread reading one partner's line per round */
+int find_max_tree(const int *array, int n) {
+    int threads = omp_get_max_threads();
+    padded_int partials[threads];
+
+#pragma omp parallel num_threads(threads)
+    {
+        int thread = omp_get_thread_num();
+        int count = omp_get_num_threads();
+        int local = array[0];
+#pragma omp for schedule(runtime)
+        for (int i = 1; i < n; i++)
+            if (array[i] > local)
+                local = array[i];
+        partials[thread].value = local;
+#pragma omp barrier
+
+        for (int stride = 1; stride < count; stride *= 2) {
+            if (thread % (2 * stride) == 0 && thread + stride < count &&
+                partials[thread + stride].value > partials[thread].value)
+                partials[thread].value = partials[thread + stride].value;
+#pragma omp barrier
+        }
+    }
+    return partials[0].value;
 }
 
 int find_max_sequential(const int *array, int n) {
@@ -113,17 +308,127 @@ int find_max_sequential(const int *array, int n) {
     return max_value;
 }
 
-void create_random_array(int length, int **array) {
-    *array = (int *)calloc(length, sizeof(int));
-    for (int i = 0; i < length; i++)
-        (*array)[i] = rand();
+typedef struct {
+    const char *name;
+    int (*find_max)(const int *array, int n);
+} max_variant;
+
+typedef struct {
+    const int *array;
+    int n;
+    int (*find_max)(const int *array, int n);
+    int max_value;
+} max_benchmark;
+
+void run_find_max(void *ctx) {
+    max_benchmark *benchmark = (max_benchmark *)ctx;
+    benchmark->max_value = benchmark->find_max(benchmark->array, benchmark->n);
+}
+
+/* Skewed-cost items: the work per index grows with the index, the worst case for schedule(static) */
+long long prime_item(long long i, long long n) {
+    (void)n;
+    if (i < 2)
+        return 0;
+    for (long long d = 2; d * d <= i; d++)
+        if (i % d == 0)
+            return 0;
+    return 1;
 }
 
-int main() {
+/* The same squaring loop as lab2's power(), with the round count rising from 0 to POWER_MAX_ROUNDS */
+long long power_item(long long i, long long n) {
+    long long rounds = POWER_MAX_ROUNDS * i / n;
+    unsigned long long result = i;
+    for (long long r = 0; r < rounds; r++)
+        result = result * result % POWER_MODULUS;
+    return (long long)result;
+}
+
+typedef struct {
+    const char *name;
+    long long (*item)(long long i, long long n);
+    long long n;
+} skewed_kernel;
+
+long long sum_scheduled(const skewed_kernel *kernel) {
+    long long sum = 0;
+    long long n = kernel->n;
+#pragma omp parallel for schedule(runtime) reduction(+: sum)
+    for (long long i = 0; i < n; i++)
+        sum += kernel->item(i, n);
+    return sum;
+}
+
+long long sum_work_stealing(const skewed_kernel *kernel, long long grain) {
+    long long sum = 0;
+    long long n = kernel->n;
+    ws_loop loop;
+    if (ws_loop_init(&loop, omp_get_max_threads(), n, grain) != 0)
+        return -1;
+
+#pragma omp parallel num_threads(loop.threads) reduction(+: sum)
+    {
+        long long begin, end;
+        while (ws_loop_next(&loop, omp_get_thread_num(), &begin, &end))
+            for (long long i = begin; i < end; i++)
+                sum += kernel->item(i, n);
+    }
+    ws_loop_destroy(&loop);
+    return sum;
+}
+
+typedef struct {
+    const skewed_kernel *kernel;
+    long long grain;                ///< Work-stealing grain, 0 for the OpenMP schedules
+    int work_stealing;
+    long long sum;
+} skewed_benchmark;
+
+void run_skewed(void *ctx) {
+    skewed_benchmark *benchmark = (skewed_benchmark *)ctx;
+    if (benchmark->work_stealing)
+        benchmark->sum = sum_work_stealing(benchmark->kernel, benchmark->grain);
+    else
+        benchmark->sum = sum_scheduled(benchmark->kernel);
+}
+
+/* Search schedule and chunk for the max reduction and both skewed kernels, and store the winners */
+void autotune(bench_config *bench, int size, int random_seed, const skewed_kernel *skewed, int skewed_count) {
+    tuning_entry entries[1 + skewed_count];
+    dataset input;
+    if (dataset_open(&input, DIST_RANDOM, size, random_seed, 0) != 0)
+        return;
+    int *array = placement_copy_dataset(&input, omp_get_max_threads());
+    dataset_close(&input);
+    if (array == NULL)
+        return;
+
+    max_benchmark max = {array, size, find_max_reduction, 0};
+    bench_kernel kernel = {"lab4/find_max_reduction", data_distribution_name(DIST_RANDOM), size,
+                           omp_get_max_threads(), 1, (double)size * sizeof(int), NULL, run_find_max, &max};
+    tuning_search(bench, &kernel, size, NULL, 0, &entries[0]);
+    free(array);
+
+    for (int k = 0; k < skewed_count; k++) {
+        char name[BENCH_NAME_LENGTH];
+        snprintf(name, sizeof(name), "lab4/skewed_%s", skewed[k].name);
+        skewed_benchmark benchmark = {&skewed[k], 0, 0, 0};
+        bench_kernel skewed_kernel = {name, "skewed", skewed[k].n, omp_get_max_threads(), 1, 0.0, NULL, run_skewed,
+                                      &benchmark};
+        tuning_search(bench, &skewed_kernel, skewed[k].n, NULL, 0, &entries[1 + k]);
+    }
+    tuning_profile_store(entries, 1 + skewed_count);
+}
+
+/* Usage: lab4 [--autotune] [--cs=<critical section length>] [--bind=<policy>] [--places=<places>] */
+int main(int argc, char **argv) {
+    placement_configure(&argc, argv);
     printf("1) OpenMP: %d\n", _OPENMP);
 
     printf("2) Number of available processors: %d\n", omp_get_num_procs());
     printf("   Maximum number of threads: %d\n", omp_get_max_threads());
+    placement_report();
 
     printf("3) Dynamic threads adjustment is %s\n", omp_get_dynamic() ? "enabled" : "disabled");
 
@@ -138,49 +443,134 @@ int main() {
     printf("6) Schedule kind: %d\n", schedule);
     printf("   Chunk size: %d\n", chunk_size);
 
-    int n = 1000;
-    int unique_values[n];
-    int unique_count = function_with_locks(n, unique_values);
-    printf("7) Unique values of the variable for %d runs: ", n);
-    for (int i = 0; i < unique_count; i++) {
-        printf("%d", unique_values[i]);
-        printf(i < unique_count - 1 ? ", " : "\n");
-    }
-
-    printf("\n8) Finding the maximum element in an array\n");
     int sizes[] = {1000000, 25000000, 50000000, 75000000, 100000000};
     const int repetitions_number = 3;
     const int random_seed = 920215;
+    const skewed_kernel skewed[] = {
+        {"primes", prime_item, 2000000},
+        {"power", power_item, 100000},
+    };
+
+    bench_config bench;
+    bench_config_default(&bench);
+    bench.warmup = 1;
+    bench.min_repetitions = repetitions_number;
+    bench_config_env(&bench);
+
+    int tune = 0;
+    int cs_lengths[] = {0, 100, 1000};
+    int cs_count = sizeof(cs_lengths) / sizeof(cs_lengths[0]);
+    for (int a = 1; a < argc; a++) {
+        if (strcmp(argv[a], "--autotune") == 0)
+            tune = 1;
+        else if (strncmp(argv[a], "--cs=", 5) == 0) {
+            cs_lengths[0] = atoi(argv[a] + 5);
+            cs_count = 1;
+        }
+    }
+
+    if (tune) {
+        printf("\n7) Autotuning schedule and chunk size, profile %s\n", tuning_profile_path());
+        autotune(&bench, sizes[0], random_seed, skewed, sizeof(skewed) / sizeof(skewed[0]));
+        return 0;
+    }
+
+    printf("\n7) Synchronization primitives under contention\n");
+    sync_suite(&bench, cs_lengths, cs_count, SYNC_OPERATIONS);
+
+    printf("\n8) Finding the maximum element in an array\n");
 
-    for (int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    const schedule_policy policies[] = {
+        {"static", omp_sched_static},
+        {"dynamic", omp_sched_dynamic},
+        {"guided", omp_sched_guided},
+        {"auto", omp_sched_auto},
+    };
+    const max_variant combiners[] = {
+        {"reduction", find_max_reduction},
+        {"padded", find_max_padded},
+        {"cas", find_max_cas},
+        {"tree", find_max_tree},
+    };
+    const int chunks[] = {0, 64, 4096, 65536};     ///< 0 keeps the policy's default chunk
+    const int policy_count = (int) (sizeof(policies) / sizeof(policies[0]));
+    const int combiner_count = (int) (sizeof(combiners) / sizeof(combiners[0]));
+    const int chunk_count = (int) (sizeof(chunks) / sizeof(chunks[0]));
+    const int size_count = (int) (sizeof(sizes) / sizeof(sizes[0]));
+
+    for (int i = 0; i < size_count; i++) {
         int size = sizes[i];
         printf("\n   TIME MEASUREMENT (%d elements)\n", size);
 
-        double time = 0;
-        int *array;
-        for (int j = 0; j < 5; j++) {
-            for (int k = 0; k < repetitions_number; k++) {
-                create_random_array(size, &array);
-
-                double t0 = omp_get_wtime();
-                if (j == 0) find_max_static(array, size);
-                else if (j == 1) find_max_dynamic(array, size);
-                else if (j == 2) find_max_guided(array, size);
-                else if (j == 3) find_max_auto(array, size);
-                else if (j == 4) find_max_sequential(array, size);
-                double t1 = omp_get_wtime();
-                time += t1 - t0;
-
-                free(array);
+        dataset input;
+        if (dataset_open(&input, DIST_RANDOM, size, random_seed, 0) != 0)
+            return 1;
+        int *array = placement_copy_dataset(&input, omp_get_max_threads());
+        dataset_close(&input);
+        if (array == NULL)
+            return 1;
+        placement_report_pages("   input", array, (size_t)size * sizeof(int));
+
+        max_benchmark benchmark = {array, size, NULL, 0};
+        for (int p = 0; p < policy_count; p++) {
+            for (int c = 0; c < chunk_count; c++) {
+                if (policies[p].kind == omp_sched_auto && chunks[c] > 0)
+                    continue;
+                omp_set_schedule(policies[p].kind, chunks[c]);
+
+                for (int j = 0; j < combiner_count; j++) {
+                    char name[BENCH_NAME_LENGTH];
+                    if (chunks[c] > 0)
+                        snprintf(name, sizeof(name), "find_max_%s/%d/%s", policies[p].name, chunks[c], combiners[j].name);
+                    else
+                        snprintf(name, sizeof(name), "find_max_%s/default/%s", policies[p].name, combiners[j].name);
+                    benchmark.find_max = combiners[j].find_max;
+                    bench_kernel kernel = {name, data_distribution_name(DIST_RANDOM), size, omp_get_max_threads(), 1,
+                                           (double)size * sizeof(int), NULL, run_find_max, &benchmark};
+                    bench_result result;
+                    bench_run(&bench, &kernel, &result);
+                }
+            }
+        }
+
+        benchmark.find_max = find_max_sequential;
+        bench_kernel kernel = {"find_max_sequential", data_distribution_name(DIST_RANDOM), size, 1, 1,
+                               (double)size * sizeof(int), NULL, run_find_max, &benchmark};
+        bench_result result;
+        bench_run(&bench, &kernel, &result);
+        free(array);
+    }
+
+    printf("\n9) Load imbalance: skewed per-element cost\n");
+
+    const int skewed_count = (int) (sizeof(skewed) / sizeof(skewed[0]));
+    for (int k = 0; k < skewed_count; k++) {
+        skewed_benchmark benchmark = {&skewed[k], 0, 0, 0};
+        /* One slot past the OpenMP policies runs the work-stealing scheduler */
+        for (int p = 0; p <= policy_count; p++) {
+            int work_stealing = p == policy_count;
+            for (int c = 0; c < chunk_count; c++) {
+                if (!work_stealing && policies[p].kind == omp_sched_auto && chunks[c] > 0)
+                    continue;
+                if (!work_stealing)
+                    omp_set_schedule(policies[p].kind, chunks[c]);
+
+                char name[BENCH_NAME_LENGTH];
+                const char *policy = work_stealing ? "work_stealing" : policies[p].name;
+                if (chunks[c] > 0)
+                    snprintf(name, sizeof(name), "skewed_%s/%s/%d", skewed[k].name, policy, chunks[c]);
+                else
+                    snprintf(name, sizeof(name), "skewed_%s/%s/default", skewed[k].name, policy);
+                benchmark.work_stealing = work_stealing;
+                benchmark.grain = chunks[c];
+                bench_kernel kernel = {name, "skewed", skewed[k].n, omp_get_max_threads(), 1, 0.0, NULL, run_skewed,
+                                       &benchmark};
+                bench_result result;
+                bench_run(&bench, &kernel, &result);
             }
-            if (j == 0) printf("   STATIC:  time = ");
-            else if (j == 1) printf("   DYNAMIC: time = ");
-            else if (j == 2) printf("   GUIDED:  time = ");
-            else if (j == 3) printf("   AUTO:    time = ");
-            else printf("   SEQUENT: time = ");
-            printf("%f;\n", time / repetitions_number);
         }
+        printf("   %s checksum: %lld\n", skewed[k].name, benchmark.sum);
     }
 
-    return 0;
+    return bench_finish(&bench) > 0;
 }
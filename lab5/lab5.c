@@ -1,10 +1,18 @@
+#define _GNU_SOURCE
 #include <stdlib.h>
 #include <stdio.h>
+#include <stddef.h>
+#include <limits.h>
 #include <mpi.h>
+#include <omp.h>
+#include "../common/random_data.h"
+#include "../common/bench.h"
+#include "../common/max_kernels.h"
 
 #define NUM_RUNS 10
 #define ARRAY_SIZE 10000000
 #define TOTAL_PROCESSES 5
+#define MAX_TILE_INTS 4096
 
 void initialize_mpi(int argc, char** argv, int* status, int* num_procs, int* rank) {
     *status = MPI_Init(&argc, &argv);
@@ -12,33 +20,296 @@ void initialize_mpi(int argc, char** argv, int* status, int* num_procs, int* ran
     MPI_Comm_rank(MPI_COMM_WORLD, rank);
 }
 
-void open_result_file(FILE** file, int rank) {
+double max_over_ranks(double seconds) {
+    double global_seconds = seconds;
+    MPI_Allreduce(&seconds, &global_seconds, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+    return global_seconds;
+}
+
+void sum_over_ranks(uint64_t* values, int count) {
+    MPI_Allreduce(MPI_IN_PLACE, values, count, MPI_UINT64_T, MPI_SUM, MPI_COMM_WORLD);
+}
+
+void initialize_array(int* array, int seed, int rank) {
     if (rank == 0) {
-        *file = fopen("/home/papkovas/CLionProjects/par_prog/lab5/results", "a");
-        if (*file == NULL) {
-            printf("Could not open the results file!\n");
-            MPI_Abort(MPI_COMM_WORLD, 1);
+        generate_data(array, ARRAY_SIZE, DIST_RANDOM, seed);
+    }
+}
+
+void slice_bounds(int rank, int num_procs, int* start, int* end) {
+    *start = (int)((long long)rank * ARRAY_SIZE / num_procs);
+    *end = (int)((long long)(rank + 1) * ARRAY_SIZE / num_procs);
+}
+
+void find_local_max(const int* slice, int count, int* local_max) {
+    *local_max = -1;
+    for (int i = 0; i < count; i++) {
+        if (slice[i] > *local_max) {
+            *local_max = slice[i];
         }
     }
 }
 
-void initialize_array(int* array, int seed, int rank) {
-    if (rank == 0) {
-        srand(seed);
-        for (int i = 0; i < ARRAY_SIZE; i++) {
-            array[i] = rand();
+/* How the input reaches the ranks; every mode is timed from generation to the reduced max */
+typedef enum {
+    DISTRIBUTE_BCAST,       ///< Rank 0 generates everything and broadcasts the whole array
+    DISTRIBUTE_SCATTERV,    ///< Rank 0 generates everything and sends every rank only its slice
+    DISTRIBUTE_GENERATE,    ///< Every rank generates its own slice of the same counter-based stream
+    DISTRIBUTE_COUNT
+} distribution_mode;
+
+const char* distribution_mode_name(distribution_mode mode) {
+    switch (mode) {
+        case DISTRIBUTE_BCAST:
+            return "mpi_find_max_bcast";
+        case DISTRIBUTE_SCATTERV:
+            return "mpi_find_max_scatterv";
+        case DISTRIBUTE_GENERATE:
+            return "mpi_find_max_generated";
+        default:
+            return "unknown";
+    }
+}
+
+typedef struct {
+    distribution_mode mode;
+    int seed;
+    int* array;             ///< Whole array: on every rank for Bcast, on rank 0 for Scatterv
+    int* slice;             ///< This rank's slice
+    int* counts;            ///< Slice sizes and offsets of all ranks, for Scatterv
+    int* displacements;
+    int rank;
+    int num_procs;
+    int global_max;
+} max_benchmark;
+
+void run_find_max(void* ctx) {
+    max_benchmark* benchmark = (max_benchmark*)ctx;
+    int start, end;
+    const int* slice = benchmark->slice;
+    slice_bounds(benchmark->rank, benchmark->num_procs, &start, &end);
+
+    switch (benchmark->mode) {
+        case DISTRIBUTE_BCAST:
+            initialize_array(benchmark->array, benchmark->seed, benchmark->rank);
+            MPI_Bcast(benchmark->array, ARRAY_SIZE, MPI_INT, 0, MPI_COMM_WORLD);
+            slice = benchmark->array + start;
+            break;
+        case DISTRIBUTE_SCATTERV:
+            initialize_array(benchmark->array, benchmark->seed, benchmark->rank);
+            MPI_Scatterv(benchmark->array, benchmark->counts, benchmark->displacements, MPI_INT, benchmark->slice,
+                         end - start, MPI_INT, 0, MPI_COMM_WORLD);
+            break;
+        case DISTRIBUTE_GENERATE:
+        default:
+            generate_data_range(benchmark->slice, ARRAY_SIZE, start, end, DIST_RANDOM, benchmark->seed);
+            break;
+    }
+
+    int local_max = -1;
+    find_local_max(slice, end - start, &local_max);
+    MPI_Reduce(&local_max, &benchmark->global_max, 1, MPI_INT, MPI_MAX, 0, MPI_COMM_WORLD);
+}
+
+/* Local max with every OpenMP thread of the rank, each running the widest SIMD kernel over its tiles */
+int hybrid_local_max(const int* slice, int count, max_kernel_t kernel) {
+    int tiles = (count + MAX_TILE_INTS - 1) / MAX_TILE_INTS;
+    int max = INT_MIN;
+    #pragma omp parallel for schedule(static) reduction(max: max)
+    for (int tile = 0; tile < tiles; tile++) {
+        int begin = tile * MAX_TILE_INTS;
+        int length = count - begin < MAX_TILE_INTS ? count - begin : MAX_TILE_INTS;
+        int tile_max = kernel(slice + begin, length);
+        max = tile_max > max ? tile_max : max;
+    }
+    return max;
+}
+
+/*
+ * Allreduce by recursive doubling: ranks past the largest power of two
+ * first hand their value to a partner below it, the power-of-two group
+ * swaps partial maxima across log2(p) dimensions, and the partners send
+ * the result back.
+ */
+int recursive_doubling_max(int value, MPI_Comm comm) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    int power = 1;
+    while (power * 2 <= size)
+        power *= 2;
+    int extra = size - power;
+
+    if (rank >= power) {
+        MPI_Send(&value, 1, MPI_INT, rank - power, 0, comm);
+        MPI_Recv(&value, 1, MPI_INT, rank - power, 0, comm, MPI_STATUS_IGNORE);
+        return value;
+    }
+    int other;
+    if (rank < extra) {
+        MPI_Recv(&other, 1, MPI_INT, rank + power, 0, comm, MPI_STATUS_IGNORE);
+        value = other > value ? other : value;
+    }
+    for (int mask = 1; mask < power; mask <<= 1) {
+        int partner = rank ^ mask;
+        MPI_Sendrecv(&value, 1, MPI_INT, partner, 0, &other, 1, MPI_INT, partner, 0, comm, MPI_STATUS_IGNORE);
+        value = other > value ? other : value;
+    }
+    if (rank < extra)
+        MPI_Send(&value, 1, MPI_INT, rank + power, 0, comm);
+    return value;
+}
+
+typedef enum {
+    COMBINE_REDUCE,
+    COMBINE_ALLREDUCE,
+    COMBINE_IREDUCE,
+    COMBINE_RECURSIVE_DOUBLING,
+    COMBINE_STATS,          ///< max, min, sum and argmax in one pass and one MPI_Reduce with a custom op
+    COMBINE_COUNT
+} combine_mode;
+
+const char* combine_mode_name(combine_mode mode) {
+    switch (mode) {
+        case COMBINE_REDUCE:
+            return "mpi_find_max_hybrid/reduce";
+        case COMBINE_ALLREDUCE:
+            return "mpi_find_max_hybrid/allreduce";
+        case COMBINE_IREDUCE:
+            return "mpi_find_max_hybrid/ireduce";
+        case COMBINE_RECURSIVE_DOUBLING:
+            return "mpi_find_max_hybrid/recursive_doubling";
+        case COMBINE_STATS:
+            return "mpi_stats_hybrid/custom_op";
+        default:
+            return "unknown";
+    }
+}
+
+typedef struct {
+    int max;
+    int min;
+    long long sum;
+    long long argmax;       ///< Global index of the first maximum
+} array_stats;
+
+/* Tiles keep the SIMD-friendly max/min/sum loop; a tile that raises the max is rescanned for its index */
+array_stats hybrid_local_stats(const int* slice, int count, long long offset) {
+    int tiles = (count + MAX_TILE_INTS - 1) / MAX_TILE_INTS;
+    array_stats total = {INT_MIN, INT_MAX, 0, -1};
+    #pragma omp parallel
+    {
+        array_stats local = {INT_MIN, INT_MAX, 0, -1};
+        #pragma omp for schedule(static) nowait
+        for (int tile = 0; tile < tiles; tile++) {
+            int begin = tile * MAX_TILE_INTS;
+            int end = count - begin < MAX_TILE_INTS ? count : begin + MAX_TILE_INTS;
+            int max = INT_MIN, min = INT_MAX;
+            long long sum = 0;
+            #pragma omp simd reduction(max: max) reduction(min: min) reduction(+: sum)
+            for (int i = begin; i < end; i++) {
+                max = slice[i] > max ? slice[i] : max;
+                min = slice[i] < min ? slice[i] : min;
+                sum += slice[i];
+            }
+            if (max > local.max) {
+                local.max = max;
+                for (int i = begin; i < end; i++)
+                    if (slice[i] == max) {
+                        local.argmax = offset + i;
+                        break;
+                    }
+            }
+            local.min = min < local.min ? min : local.min;
+            local.sum += sum;
+        }
+        #pragma omp critical
+        {
+            if (local.max > total.max || (local.max == total.max && local.argmax < total.argmax)) {
+                total.max = local.max;
+                total.argmax = local.argmax;
+            }
+            total.min = local.min < total.min ? local.min : total.min;
+            total.sum += local.sum;
         }
     }
+    return total;
 }
 
-void find_local_max(int* array, int rank, int num_procs, int* local_max) {
-    int start = rank * ARRAY_SIZE / num_procs;
-    int end = (rank + 1) * ARRAY_SIZE / num_procs;
-    *local_max = -1;
-    for (int i = start; i < end; i++) {
-        if (array[i] > *local_max) {
-            *local_max = array[i];
+void combine_stats(void* in, void* inout, int* len, MPI_Datatype* type) {
+    const array_stats* a = (const array_stats*)in;
+    array_stats* b = (array_stats*)inout;
+    for (int i = 0; i < *len; i++) {
+        if (a[i].max > b[i].max || (a[i].max == b[i].max && a[i].argmax < b[i].argmax)) {
+            b[i].max = a[i].max;
+            b[i].argmax = a[i].argmax;
         }
+        b[i].min = a[i].min < b[i].min ? a[i].min : b[i].min;
+        b[i].sum += a[i].sum;
+    }
+    (void)type;
+}
+
+MPI_Datatype create_stats_type(void) {
+    int lengths[] = {2, 2};
+    MPI_Aint offsets[] = {offsetof(array_stats, max), offsetof(array_stats, sum)};
+    MPI_Datatype types[] = {MPI_INT, MPI_LONG_LONG};
+    MPI_Datatype packed, resized;
+    MPI_Type_create_struct(2, lengths, offsets, types, &packed);
+    MPI_Type_create_resized(packed, 0, sizeof(array_stats), &resized);
+    MPI_Type_free(&packed);
+    MPI_Type_commit(&resized);
+    return resized;
+}
+
+typedef struct {
+    combine_mode mode;
+    int seed;
+    int* slice;
+    int rank;
+    int num_procs;
+    max_kernel_t kernel;
+    MPI_Datatype stats_type;
+    MPI_Op stats_op;
+    int global_max;
+    array_stats stats;
+} hybrid_benchmark;
+
+void generate_slice(void* ctx) {
+    hybrid_benchmark* benchmark = (hybrid_benchmark*)ctx;
+    int start, end;
+    slice_bounds(benchmark->rank, benchmark->num_procs, &start, &end);
+    generate_data_range(benchmark->slice, ARRAY_SIZE, start, end, DIST_RANDOM, benchmark->seed);
+}
+
+void run_hybrid(void* ctx) {
+    hybrid_benchmark* benchmark = (hybrid_benchmark*)ctx;
+    int start, end;
+    slice_bounds(benchmark->rank, benchmark->num_procs, &start, &end);
+
+    if (benchmark->mode == COMBINE_STATS) {
+        array_stats local = hybrid_local_stats(benchmark->slice, end - start, start);
+        MPI_Reduce(&local, &benchmark->stats, 1, benchmark->stats_type, benchmark->stats_op, 0, MPI_COMM_WORLD);
+        return;
+    }
+
+    int local_max = hybrid_local_max(benchmark->slice, end - start, benchmark->kernel);
+    MPI_Request request;
+    switch (benchmark->mode) {
+        case COMBINE_REDUCE:
+            MPI_Reduce(&local_max, &benchmark->global_max, 1, MPI_INT, MPI_MAX, 0, MPI_COMM_WORLD);
+            break;
+        case COMBINE_ALLREDUCE:
+            MPI_Allreduce(&local_max, &benchmark->global_max, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+            break;
+        case COMBINE_IREDUCE:
+            MPI_Ireduce(&local_max, &benchmark->global_max, 1, MPI_INT, MPI_MAX, 0, MPI_COMM_WORLD, &request);
+            MPI_Wait(&request, MPI_STATUS_IGNORE);
+            break;
+        case COMBINE_RECURSIVE_DOUBLING:
+        default:
+            benchmark->global_max = recursive_doubling_max(local_max, MPI_COMM_WORLD);
+            break;
     }
 }
 
@@ -47,39 +318,77 @@ int main(int argc, char** argv) {
     int num_procs = 0;
     int rank = 0;
     const int seed = 1111;
-    int* array = NULL;
-    int global_max = -1;
-    double start_time, total_time = 0.0;
-    FILE* result_file = NULL;
+    bench_config bench;
+    bench_result result;
 
     initialize_mpi(argc, argv, &status, &num_procs, &rank);
-    open_result_file(&result_file, rank);
 
-    array = (int*)malloc(sizeof(int) * ARRAY_SIZE);
-    for (int run = 0; run < NUM_RUNS; run++) {
-        int local_max = -1;
+    bench_config_default(&bench);
+    bench.min_repetitions = NUM_RUNS;
+    bench.report = rank == 0;
+    bench.sync_sample = max_over_ranks;
+    bench.sync_counters = sum_over_ranks;
+    bench_config_env(&bench);
 
-        initialize_array(array, seed + run, rank);
-        MPI_Bcast(array, ARRAY_SIZE, MPI_INT, 0, MPI_COMM_WORLD);
-        start_time = MPI_Wtime();
+    int start, end;
+    slice_bounds(rank, num_procs, &start, &end);
+    int* counts = (int*)malloc(sizeof(int) * num_procs);
+    int* displacements = (int*)malloc(sizeof(int) * num_procs);
+    for (int r = 0; r < num_procs; r++) {
+        int first, last;
+        slice_bounds(r, num_procs, &first, &last);
+        counts[r] = last - first;
+        displacements[r] = first;
+    }
 
-        find_local_max(array, rank, num_procs, &local_max);
+    int maxima[DISTRIBUTE_COUNT];
+    for (int mode = 0; mode < DISTRIBUTE_COUNT; mode++) {
+        int* array = NULL;
+        if (mode == DISTRIBUTE_BCAST || (mode == DISTRIBUTE_SCATTERV && rank == 0))
+            array = (int*)malloc(sizeof(int) * ARRAY_SIZE);
+        int* slice = (int*)malloc(sizeof(int) * (end - start + 1));
 
-        MPI_Reduce(&local_max, &global_max, 1, MPI_INT, MPI_MAX, 0, MPI_COMM_WORLD);
+        max_benchmark benchmark = {(distribution_mode)mode, seed, array, slice, counts, displacements, rank, num_procs,
+                                   -1};
+        bench_kernel kernel = {distribution_mode_name(mode), data_distribution_name(DIST_RANDOM), ARRAY_SIZE, 1,
+                               num_procs, (double)ARRAY_SIZE * sizeof(int), NULL, run_find_max, &benchmark};
+        bench_run(&bench, &kernel, &result);
+        maxima[mode] = benchmark.global_max;
 
-        if (rank == 0) {
-            total_time += MPI_Wtime() - start_time;
-        }
+        free(array);
+        free(slice);
     }
 
-    if (rank == 0) {
-        total_time /= NUM_RUNS;
-        fprintf(result_file, "%.7f\n", total_time);
-        fclose(result_file);
+    const max_kernel_info* kernel_info = select_max_kernel();
+    hybrid_benchmark hybrid = {COMBINE_REDUCE, seed, (int*)malloc(sizeof(int) * (end - start + 1)), rank, num_procs,
+                               kernel_info->kernel, create_stats_type(), MPI_OP_NULL, -1, {0, 0, 0, 0}};
+    MPI_Op_create(combine_stats, 1, &hybrid.stats_op);
+    if (rank == 0)
+        printf("hybrid: %d threads per rank, %s kernel\n", omp_get_max_threads(), kernel_info->name);
+    for (int mode = 0; mode < COMBINE_COUNT; mode++) {
+        hybrid.mode = (combine_mode)mode;
+        bench_kernel kernel = {combine_mode_name(mode), data_distribution_name(DIST_RANDOM), ARRAY_SIZE,
+                               omp_get_max_threads(), num_procs, (double)ARRAY_SIZE * sizeof(int), generate_slice,
+                               run_hybrid, &hybrid};
+        bench_run(&bench, &kernel, &result);
+    }
+    if (rank == 0)
+        printf("stats: max %d at %lld, min %d, sum %lld\n", hybrid.stats.max, hybrid.stats.argmax, hybrid.stats.min,
+               hybrid.stats.sum);
+    MPI_Op_free(&hybrid.stats_op);
+    MPI_Type_free(&hybrid.stats_type);
+    free(hybrid.slice);
+    bench_finish(&bench);
+
+    if (rank == 0 && (maxima[DISTRIBUTE_SCATTERV] != maxima[DISTRIBUTE_BCAST] ||
+                      maxima[DISTRIBUTE_GENERATE] != maxima[DISTRIBUTE_BCAST])) {
+        printf("max differs between modes: %d %d %d\n", maxima[DISTRIBUTE_BCAST], maxima[DISTRIBUTE_SCATTERV],
+               maxima[DISTRIBUTE_GENERATE]);
     }
 
+    free(counts);
+    free(displacements);
     MPI_Finalize();
-    free(array);
 
     return 0;
 }
@@ -1,44 +1,194 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <limits.h>
 #include <mpi.h>
+#include <omp.h>
+#include "../common/random_data.h"
+#include "../common/bench.h"
 
 #define ARRAY_SIZE 1000000
 #define ITERATIONS 10
 #define SEED_VALUE 42
+#define PIPELINE_STAGES 4
 
 
-void merge_sorted_sections(int *array, int num_sections, int section_size, int total_elements) {
-    int *temp_buffer = (int *)malloc(total_elements * sizeof(int));
-    int *indices = (int *)malloc(num_sections * sizeof(int));
+/*
+ * Loser tree over `runs` sorted runs, padded to a power of two with empty
+ * runs. Every inner node keeps the loser of the match played there and
+ * tree[0] the overall winner, so taking the smallest head replays only the
+ * log2(ways) matches on the path of the run it came from.
+ */
+typedef struct {
+    int ways;
+    int *tree;
+    const int **heads;      ///< Next element of every run
+    const int **ends;       ///< End of every run
+} loser_tree;
 
-    for (int section = 0; section < num_sections; section++) {
-        indices[section] = section * section_size;
+static inline int loser_tree_less(const loser_tree *lt, int a, int b) {
+    if (lt->heads[a] == lt->ends[a])
+        return 0;
+    if (lt->heads[b] == lt->ends[b])
+        return 1;
+    return *lt->heads[a] < *lt->heads[b] || (*lt->heads[a] == *lt->heads[b] && a < b);
+}
+
+void loser_tree_init(loser_tree *lt, const int *const *begins, const int *const *ends, int runs) {
+    int ways = 1;
+    while (ways < runs)
+        ways *= 2;
+    lt->ways = ways;
+    lt->tree = (int *)malloc(ways * sizeof(int));
+    lt->heads = (const int **)malloc(2 * ways * sizeof(const int *));
+    lt->ends = lt->heads + ways;
+    for (int run = 0; run < ways; run++) {
+        lt->heads[run] = run < runs ? begins[run] : NULL;
+        lt->ends[run] = run < runs ? ends[run] : NULL;
     }
 
-    for (int pos = 0; pos < total_elements; pos++) {
-        int min_idx = -1;
-        int min_val = INT_MAX;
-        for (int section = 0; section < num_sections; section++) {
-            if (indices[section] < (section + 1) * section_size && indices[section] < total_elements) {
-                if (array[indices[section]] < min_val) {
-                    min_val = array[indices[section]];
-                    min_idx = section;
-                }
+    int *winners = (int *)malloc(2 * ways * sizeof(int));
+    for (int run = 0; run < ways; run++)
+        winners[ways + run] = run;
+    for (int node = ways - 1; node > 0; node--) {
+        int left = winners[2 * node];
+        int right = winners[2 * node + 1];
+        int right_wins = loser_tree_less(lt, right, left);
+        winners[node] = right_wins ? right : left;
+        lt->tree[node] = right_wins ? left : right;
+    }
+    lt->tree[0] = winners[1];
+    free(winners);
+}
+
+void loser_tree_free(loser_tree *lt) {
+    free(lt->tree);
+    free(lt->heads);
+}
+
+/* Write the next `count` elements of the merge to `out` */
+void loser_tree_pop(loser_tree *lt, int *out, long long count) {
+    int ways = lt->ways;
+    int winner = lt->tree[0];
+    for (long long pos = 0; pos < count; pos++) {
+        out[pos] = *lt->heads[winner]++;
+        for (int node = (winner + ways) / 2; node > 0; node /= 2) {
+            int challenger = lt->tree[node];
+            if (loser_tree_less(lt, challenger, winner)) {
+                lt->tree[node] = winner;
+                winner = challenger;
             }
         }
+    }
+    lt->tree[0] = winner;
+}
 
-        temp_buffer[pos] = min_val;
-        if (min_idx != -1) {
-            indices[min_idx]++;
+static inline long long lower_bound(const int *begin, const int *end, long long value) {
+    const int *first = begin;
+    long long count = end - begin;
+    while (count > 0) {
+        long long half = count / 2;
+        if (first[half] < value) {
+            first += half + 1;
+            count -= half + 1;
+        } else {
+            count = half;
         }
     }
+    return first - begin;
+}
 
-    for (int pos = 0; pos < total_elements; pos++) {
-        array[pos] = temp_buffer[pos];
+/*
+ * Cut every run so that the prefixes together hold the `rank` smallest
+ * elements: a binary search for the value at that rank, then the ties are
+ * handed out run by run, which keeps the cuts of increasing ranks monotone.
+ */
+void multiway_split(const int *const *begins, const int *const *ends, int runs, long long rank, long long *cuts) {
+    long long low = INT_MIN, high = INT_MAX;
+    while (low < high) {
+        long long middle = low + (high - low) / 2;
+        long long at_most = 0;
+        for (int run = 0; run < runs; run++)
+            at_most += lower_bound(begins[run], ends[run], middle + 1);
+        if (at_most >= rank)
+            high = middle;
+        else
+            low = middle + 1;
     }
 
-    free(temp_buffer);
-    free(indices);
+    long long left = rank;
+    for (int run = 0; run < runs; run++) {
+        cuts[run] = lower_bound(begins[run], ends[run], low);
+        left -= cuts[run];
+    }
+    for (int run = 0; run < runs && left > 0; run++) {
+        long long ties = lower_bound(begins[run], ends[run], low + 1) - cuts[run];
+        long long taken = ties < left ? ties : left;
+        cuts[run] += taken;
+        left -= taken;
+    }
+}
+
+/*
+ * Merge the sorted sections [displacements[s], displacements[s] + counts[s])
+ * of `array` into `buffer` and return `buffer`, which the caller swaps with
+ * `array` instead of copying back. With more than one thread the output is
+ * split into equal slices by multiway_split and every thread merges its
+ * slice with its own loser tree.
+ */
+int *merge_sorted_sections(const int *array, int *buffer, int num_sections, const int *counts,
+                           const int *displacements, int threads) {
+    const int **begins = (const int **)malloc(2 * num_sections * sizeof(const int *));
+    const int **ends = begins + num_sections;
+    long long total_elements = 0;
+    for (int section = 0; section < num_sections; section++) {
+        begins[section] = array + displacements[section];
+        ends[section] = begins[section] + counts[section];
+        total_elements += counts[section];
+    }
+
+    if (threads <= 1 || total_elements < threads) {
+        loser_tree lt;
+        loser_tree_init(&lt, begins, ends, num_sections);
+        loser_tree_pop(&lt, buffer, total_elements);
+        loser_tree_free(&lt);
+        free(begins);
+        return buffer;
+    }
+
+    long long *cuts = (long long *)malloc((threads + 1) * num_sections * sizeof(long long));
+    #pragma omp parallel num_threads(threads)
+    {
+        int thread = omp_get_thread_num();
+        int team = omp_get_num_threads();
+        long long first = total_elements * thread / team;
+        long long last = total_elements * (thread + 1) / team;
+        long long *lower = cuts + thread * num_sections;
+        long long *upper = cuts + (thread + 1) * num_sections;
+
+        multiway_split(begins, ends, num_sections, first, lower);
+        if (thread == team - 1) {
+            for (int section = 0; section < num_sections; section++)
+                upper[section] = counts[section];
+        }
+        #pragma omp barrier
+
+        const int **slice = (const int **)malloc(2 * num_sections * sizeof(const int *));
+        for (int section = 0; section < num_sections; section++) {
+            slice[section] = begins[section] + lower[section];
+            slice[num_sections + section] = begins[section] + upper[section];
+        }
+        loser_tree lt;
+        loser_tree_init(&lt, slice, slice + num_sections, num_sections);
+        loser_tree_pop(&lt, buffer + first, last - first);
+        loser_tree_free(&lt);
+        free(slice);
+    }
+
+    free(cuts);
+    free(begins);
+    return buffer;
 }
 
 void insertion_sort_gap(int arr[], int gap, int length, int start) {
@@ -65,67 +215,433 @@ void shell_sort(int arr[], int length) {
 }
 
 void initialize_array(int *array, int size, int seed) {
-    srand(seed);
+    generate_data(array, size, DIST_RANDOM, seed);
+}
+
+double max_over_ranks(double seconds) {
+    double global_seconds = seconds;
+    MPI_Allreduce(&seconds, &global_seconds, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+    return global_seconds;
+}
+
+void sum_over_ranks(uint64_t *values, int count) {
+    MPI_Allreduce(MPI_IN_PLACE, values, count, MPI_UINT64_T, MPI_SUM, MPI_COMM_WORLD);
+}
+
+typedef struct {
+    MPI_Comm comm;          ///< Ranks taking part, MPI_COMM_NULL on the others
+    int rank;
+    int size;
+    int chunk_size;         ///< Elements of this rank
+    int *counts;            ///< Elements of every rank, on rank 0
+    int *displacements;
+    int merge_threads;      ///< OpenMP threads of the merges
+    int gather_result;      ///< Sample sort gathers the sorted array on rank 0 at the end
+    int *global_array;
+    int *merge_buffer;
+    int *local_array;
+    int *local_buffer;
+    /* Pipelined sort: per stage counts and displacements of every rank, stage after stage */
+    int *stage_counts;
+    int *stage_displacements;
+    MPI_Request *requests;
+    /* Compute time of the blocking timeline, summed over its runs */
+    double sort_seconds;
+    double merge_seconds;
+    int timed_runs;
+    /* Sample sort: the sorted slice this rank ends up with, and the exchange state */
+    int *sorted;
+    int sorted_count;
+    int *received;
+    int capacity;
+    int *samples;
+    int *splitters;
+    int *send_counts;
+    int *send_displacements;
+    int *receive_counts;
+    int *receive_displacements;
+} sort_benchmark;
+
+/* Ranks below ARRAY_SIZE % size take one extra element, so the whole array is sorted */
+void partition_array(int size, int *counts, int *displacements) {
+    for (int r = 0; r < size; r++) {
+        counts[r] = ARRAY_SIZE / size + (r < ARRAY_SIZE % size);
+        displacements[r] = r > 0 ? displacements[r - 1] + counts[r - 1] : 0;
+    }
+}
+
+void generate_input(void *ctx) {
+    sort_benchmark *benchmark = (sort_benchmark *)ctx;
+    if (benchmark->comm == MPI_COMM_NULL)
+        return;
+    if (benchmark->rank == 0) {
+        initialize_array(benchmark->global_array, ARRAY_SIZE, SEED_VALUE);
+    }
+    MPI_Barrier(benchmark->comm);
+}
+
+void scatter_input(void *ctx) {
+    sort_benchmark *benchmark = (sort_benchmark *)ctx;
+    if (benchmark->comm == MPI_COMM_NULL)
+        return;
+    if (benchmark->rank == 0) {
+        initialize_array(benchmark->global_array, ARRAY_SIZE, SEED_VALUE);
+    }
+
+    MPI_Scatterv(benchmark->global_array, benchmark->counts, benchmark->displacements, MPI_INT,
+                 benchmark->local_array, benchmark->chunk_size, MPI_INT, 0, benchmark->comm);
+    MPI_Barrier(benchmark->comm);
+}
+
+void run_gather_merge_sort(void *ctx) {
+    sort_benchmark *benchmark = (sort_benchmark *)ctx;
+    if (benchmark->comm == MPI_COMM_NULL)
+        return;
+    shell_sort(benchmark->local_array, benchmark->chunk_size);
+    MPI_Gatherv(benchmark->local_array, benchmark->chunk_size, MPI_INT, benchmark->global_array,
+                benchmark->counts, benchmark->displacements, MPI_INT, 0, benchmark->comm);
+
+    if (benchmark->rank == 0) {
+        int *sorted = merge_sorted_sections(benchmark->global_array, benchmark->merge_buffer, benchmark->size,
+                                            benchmark->counts, benchmark->displacements, benchmark->merge_threads);
+        benchmark->merge_buffer = benchmark->global_array;
+        benchmark->global_array = sorted;
+    }
+}
+
+/* Scatter, sort, gather and merge back to back, timing the compute phases as the reference for the pipeline */
+void run_blocking_merge_sort(void *ctx) {
+    sort_benchmark *benchmark = (sort_benchmark *)ctx;
+    if (benchmark->comm == MPI_COMM_NULL)
+        return;
+    MPI_Scatterv(benchmark->global_array, benchmark->counts, benchmark->displacements, MPI_INT,
+                 benchmark->local_array, benchmark->chunk_size, MPI_INT, 0, benchmark->comm);
+
+    double start = MPI_Wtime();
+    shell_sort(benchmark->local_array, benchmark->chunk_size);
+    benchmark->sort_seconds += MPI_Wtime() - start;
+    MPI_Gatherv(benchmark->local_array, benchmark->chunk_size, MPI_INT, benchmark->global_array,
+                benchmark->counts, benchmark->displacements, MPI_INT, 0, benchmark->comm);
+
+    if (benchmark->rank == 0) {
+        start = MPI_Wtime();
+        int *sorted = merge_sorted_sections(benchmark->global_array, benchmark->merge_buffer, benchmark->size,
+                                            benchmark->counts, benchmark->displacements, benchmark->merge_threads);
+        benchmark->merge_seconds += MPI_Wtime() - start;
+        benchmark->merge_buffer = benchmark->global_array;
+        benchmark->global_array = sorted;
+    }
+    benchmark->timed_runs++;
+}
+
+/* Sorted runs waiting on rank 0, merged pairwise like a binary counter so every element moves log2(size) times */
+typedef struct {
+    int *data;
+    int count;
+    int level;
+    int owned;              ///< Allocated by the cascade, not a slice of the global array
+} pending_run;
+
+void push_run(pending_run *stack, int *depth, int *data, int count) {
+    stack[(*depth)++] = (pending_run){data, count, 0, 0};
+    while (*depth > 1 && stack[*depth - 1].level == stack[*depth - 2].level) {
+        pending_run *left = &stack[*depth - 2];
+        pending_run *right = &stack[*depth - 1];
+        const int *begins[2] = {left->data, right->data};
+        const int *ends[2] = {left->data + left->count, right->data + right->count};
+        int *merged = (int *)malloc(((long long)left->count + right->count + 1) * sizeof(int));
+        loser_tree lt;
+        loser_tree_init(&lt, begins, ends, 2);
+        loser_tree_pop(&lt, merged, (long long)left->count + right->count);
+        loser_tree_free(&lt);
+
+        if (left->owned)
+            free(left->data);
+        if (right->owned)
+            free(right->data);
+        *left = (pending_run){merged, left->count + right->count, left->level + 1, 1};
+        (*depth)--;
+    }
+}
+
+/*
+ * The part of every rank travels in PIPELINE_STAGES slices, one
+ * MPI_Iscatterv each, so a rank sorts the first slice while the later ones
+ * are still on the way; it then merges its slices and sends the run with a
+ * plain MPI_Send, since nothing is left to overlap. Rank 0 posts all receives
+ * up front and folds every run into the merge as soon as MPI_Waitany
+ * reports it.
+ */
+void run_pipelined_merge_sort(void *ctx) {
+    sort_benchmark *benchmark = (sort_benchmark *)ctx;
+    if (benchmark->comm == MPI_COMM_NULL)
+        return;
+    int size = benchmark->size;
+    int rank = benchmark->rank;
+    int chunk = benchmark->chunk_size;
+    int stage_counts[PIPELINE_STAGES];
+    int stage_offsets[PIPELINE_STAGES];
+
+    for (int stage = 0; stage < PIPELINE_STAGES; stage++) {
+        stage_offsets[stage] = (int)((long long)chunk * stage / PIPELINE_STAGES);
+        stage_counts[stage] = (int)((long long)chunk * (stage + 1) / PIPELINE_STAGES) - stage_offsets[stage];
+        MPI_Iscatterv(benchmark->global_array, benchmark->stage_counts + stage * size,
+                      benchmark->stage_displacements + stage * size, MPI_INT, benchmark->local_array + stage_offsets[stage],
+                      stage_counts[stage], MPI_INT, 0, benchmark->comm, &benchmark->requests[stage]);
+    }
+
+    MPI_Request *receives = benchmark->requests + PIPELINE_STAGES;
+    if (rank == 0) {
+        for (int r = 1; r < size; r++)
+            MPI_Irecv(benchmark->merge_buffer + benchmark->displacements[r], benchmark->counts[r], MPI_INT, r, 0,
+                      benchmark->comm, &receives[r - 1]);
+    }
+
+    for (int stage = 0; stage < PIPELINE_STAGES; stage++) {
+        MPI_Wait(&benchmark->requests[stage], MPI_STATUS_IGNORE);
+        shell_sort(benchmark->local_array + stage_offsets[stage], stage_counts[stage]);
+    }
+    int *run = merge_sorted_sections(benchmark->local_array, benchmark->local_buffer, PIPELINE_STAGES, stage_counts,
+                                     stage_offsets, 1);
+
+    if (rank != 0) {
+        MPI_Send(run, chunk, MPI_INT, 0, 0, benchmark->comm);
+        return;
+    }
+
+    pending_run *stack = (pending_run *)malloc((size + 1) * sizeof(pending_run));
+    int depth = 0;
+    push_run(stack, &depth, run, chunk);
+    for (int arrived = 1; arrived < size; arrived++) {
+        int index;
+        MPI_Waitany(size - 1, receives, &index, MPI_STATUS_IGNORE);
+        push_run(stack, &depth, benchmark->merge_buffer + benchmark->displacements[index + 1],
+                 benchmark->counts[index + 1]);
+    }
+
+    const int **begins = (const int **)calloc(2 * depth, sizeof(const int *));
+    for (int r = 0; r < depth; r++) {
+        begins[r] = stack[r].data;
+        begins[depth + r] = stack[r].data + stack[r].count;
+    }
+    loser_tree lt;
+    loser_tree_init(&lt, begins, begins + depth, depth);
+    loser_tree_pop(&lt, benchmark->global_array, ARRAY_SIZE);
+    loser_tree_free(&lt);
+
+    for (int r = 0; r < depth; r++)
+        if (stack[r].owned)
+            free(stack[r].data);
+    free(begins);
+    free(stack);
+}
+
+/* Transfer time of the blocking timeline (its median minus the compute phases) and the part the pipeline hid */
+void report_overlap(const sort_benchmark *benchmark, double blocking, double pipelined) {
+    double compute[2] = {benchmark->timed_runs > 0 ? benchmark->sort_seconds / benchmark->timed_runs : 0.0,
+                         benchmark->timed_runs > 0 ? benchmark->merge_seconds / benchmark->timed_runs : 0.0};
+    MPI_Allreduce(MPI_IN_PLACE, compute, 2, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+    if (benchmark->comm == MPI_COMM_NULL || benchmark->rank != 0)
+        return;
+
+    double transfer = blocking - compute[0] - compute[1];
+    double hidden = blocking - pipelined;
+    printf("   overlap: blocking %.6f s (sort %.6f, merge %.6f, transfer %.6f), pipelined %.6f s, hidden %.6f s",
+           blocking, compute[0], compute[1], transfer, pipelined, hidden);
+    if (transfer > 0.0)
+        printf(" (%.0f%% of the transfer)", 100.0 * hidden / transfer);
+    printf("\n");
+}
+
+int compare_ints(const void *a, const void *b) {
+    int left = *(const int *)a;
+    int right = *(const int *)b;
+    return (left > right) - (left < right);
+}
+
+/*
+ * Sample sort by regular sampling: every rank sorts its part and offers
+ * `size` evenly spaced samples, all ranks pick the same size - 1 splitters
+ * from the gathered samples, and one Alltoallv sends every element to the
+ * rank of its bucket, where the incoming sorted runs are merged. The
+ * result stays distributed in rank order unless gather_result is set.
+ */
+void run_sample_sort(void *ctx) {
+    sort_benchmark *benchmark = (sort_benchmark *)ctx;
+    if (benchmark->comm == MPI_COMM_NULL)
+        return;
+    int size = benchmark->size;
+    int count = benchmark->chunk_size;
+    int *local = benchmark->local_array;
+    shell_sort(local, count);
+
+    int *offered = benchmark->samples + size * size;
+    for (int i = 0; i < size; i++)
+        offered[i] = count > 0 ? local[(long long)count * i / size] : INT_MAX;
+    MPI_Allgather(offered, size, MPI_INT, benchmark->samples, size, MPI_INT, benchmark->comm);
+    qsort(benchmark->samples, size * size, sizeof(int), compare_ints);
+    for (int i = 1; i < size; i++)
+        benchmark->splitters[i - 1] = benchmark->samples[i * size + size / 2 - 1];
+
+    int previous = 0;
     for (int i = 0; i < size; i++) {
-        array[i] = (rand() + 1) * rand();
+        int boundary = i < size - 1 ? (int)lower_bound(local, local + count, (long long)benchmark->splitters[i] + 1)
+                                    : count;
+        benchmark->send_displacements[i] = previous;
+        benchmark->send_counts[i] = boundary - previous;
+        previous = boundary;
+    }
+    MPI_Alltoall(benchmark->send_counts, 1, MPI_INT, benchmark->receive_counts, 1, MPI_INT, benchmark->comm);
+
+    int received = 0;
+    for (int i = 0; i < size; i++) {
+        benchmark->receive_displacements[i] = received;
+        received += benchmark->receive_counts[i];
+    }
+    if (received > benchmark->capacity) {
+        free(benchmark->received);
+        free(benchmark->sorted);
+        benchmark->capacity = received;
+        benchmark->received = (int *)malloc(received * sizeof(int));
+        benchmark->sorted = (int *)malloc(received * sizeof(int));
+    }
+    MPI_Alltoallv(local, benchmark->send_counts, benchmark->send_displacements, MPI_INT, benchmark->received,
+                  benchmark->receive_counts, benchmark->receive_displacements, MPI_INT, benchmark->comm);
+
+    merge_sorted_sections(benchmark->received, benchmark->sorted, size, benchmark->receive_counts,
+                          benchmark->receive_displacements, benchmark->merge_threads);
+    benchmark->sorted_count = received;
+
+    if (benchmark->gather_result) {
+        MPI_Gather(&received, 1, MPI_INT, benchmark->receive_counts, 1, MPI_INT, 0, benchmark->comm);
+        if (benchmark->rank == 0) {
+            for (int i = 0; i < size; i++)
+                benchmark->receive_displacements[i] =
+                    i > 0 ? benchmark->receive_displacements[i - 1] + benchmark->receive_counts[i - 1] : 0;
+        }
+        MPI_Gatherv(benchmark->sorted, received, MPI_INT, benchmark->global_array, benchmark->receive_counts,
+                    benchmark->receive_displacements, MPI_INT, 0, benchmark->comm);
     }
 }
 
-void open_output_file(FILE **file, const char *filename) {
-    *file = fopen(filename, "a");
-    if (*file == NULL) {
-        printf("Error: Unable to open file!\n");
-        MPI_Abort(MPI_COMM_WORLD, 1);
+/* Run on the first `ranks` ranks only; the others sit the measurements out and get MPI_COMM_NULL */
+void sort_benchmark_select(sort_benchmark *benchmark, int world_rank, int ranks) {
+    if (benchmark->comm != MPI_COMM_NULL)
+        MPI_Comm_free(&benchmark->comm);
+    MPI_Comm_split(MPI_COMM_WORLD, world_rank < ranks ? 0 : MPI_UNDEFINED, world_rank, &benchmark->comm);
+    if (benchmark->comm == MPI_COMM_NULL)
+        return;
+
+    MPI_Comm_rank(benchmark->comm, &benchmark->rank);
+    MPI_Comm_size(benchmark->comm, &benchmark->size);
+    partition_array(benchmark->size, benchmark->counts, benchmark->displacements);
+    benchmark->chunk_size = benchmark->counts[benchmark->rank];
+    for (int stage = 0; stage < PIPELINE_STAGES; stage++) {
+        for (int r = 0; r < benchmark->size; r++) {
+            int first = (int)((long long)benchmark->counts[r] * stage / PIPELINE_STAGES);
+            int last = (int)((long long)benchmark->counts[r] * (stage + 1) / PIPELINE_STAGES);
+            benchmark->stage_counts[stage * benchmark->size + r] = last - first;
+            benchmark->stage_displacements[stage * benchmark->size + r] = benchmark->displacements[r] + first;
+        }
     }
 }
 
+/* Usage: lab6, compares the sorts on 1, 2, 4, ... and all ranks of the run */
 int main(int argc, char **argv) {
     int rank, size;
-    double start_time, total_time = 0.0;
-    FILE *result_file = NULL;
+    bench_config bench;
+    bench_result result;
 
     MPI_Init(&argc, &argv);
     MPI_Comm_size(MPI_COMM_WORLD, &size);
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
 
-    if (rank == 0) {
-        open_output_file(&result_file, "/home/papkovas/ClionProjects/par_prog/lab6/new_results");
-    }
+    bench_config_default(&bench);
+    bench.min_repetitions = ITERATIONS;
+    bench.report = rank == 0;
+    bench.sync_sample = max_over_ranks;
+    bench.sync_counters = sum_over_ranks;
+    bench_config_env(&bench);
 
-    int chunk_size = ARRAY_SIZE / size;
-    int *global_array = NULL;
-    int *local_array = (int *)malloc(chunk_size * sizeof(int));
+    sort_benchmark benchmark;
+    memset(&benchmark, 0, sizeof(benchmark));
+    benchmark.comm = MPI_COMM_NULL;
+    benchmark.counts = (int *)malloc(size * sizeof(int));
+    benchmark.displacements = (int *)malloc(size * sizeof(int));
+    benchmark.stage_counts = (int *)malloc(2 * PIPELINE_STAGES * size * sizeof(int));
+    benchmark.stage_displacements = benchmark.stage_counts + PIPELINE_STAGES * size;
+    benchmark.requests = (MPI_Request *)malloc((PIPELINE_STAGES + size) * sizeof(MPI_Request));
+    benchmark.samples = (int *)malloc((size + 1) * size * sizeof(int));
+    benchmark.splitters = (int *)malloc(size * sizeof(int));
+    benchmark.send_counts = (int *)malloc(4 * size * sizeof(int));
+    benchmark.send_displacements = benchmark.send_counts + size;
+    benchmark.receive_counts = benchmark.send_counts + 2 * size;
+    benchmark.receive_displacements = benchmark.send_counts + 3 * size;
 
     if (rank == 0) {
-        global_array = (int *)malloc(ARRAY_SIZE * sizeof(int));
+        benchmark.global_array = (int *)malloc(ARRAY_SIZE * sizeof(int));
+        benchmark.merge_buffer = (int *)malloc(ARRAY_SIZE * sizeof(int));
     }
 
-    for (int iteration = 0; iteration < ITERATIONS; iteration++) {
-        if (rank == 0) {
-            initialize_array(global_array, ARRAY_SIZE, SEED_VALUE + iteration);
-        }
+    const int threads = omp_get_max_threads();
+    for (int ranks = 1;; ranks = 2 * ranks < size ? 2 * ranks : size) {
+        free(benchmark.local_array);
+        free(benchmark.local_buffer);
+        benchmark.local_array = (int *)malloc((ARRAY_SIZE / ranks + 1) * sizeof(int));
+        benchmark.local_buffer = (int *)malloc((ARRAY_SIZE / ranks + 1) * sizeof(int));
+        sort_benchmark_select(&benchmark, rank, ranks);
 
-        MPI_Scatter(global_array, chunk_size, MPI_INT, local_array, chunk_size, MPI_INT, 0, MPI_COMM_WORLD);
-        MPI_Barrier(MPI_COMM_WORLD);
+        bench_kernel kernel = {"gather_merge_sort", data_distribution_name(DIST_RANDOM), ARRAY_SIZE, 1, ranks, 0.0,
+                               scatter_input, run_gather_merge_sort, &benchmark};
+        benchmark.merge_threads = 1;
+        bench_run(&bench, &kernel, &result);
 
-        if (rank == 0) start_time = MPI_Wtime();
-        shell_sort(local_array, chunk_size);
-        MPI_Gather(local_array, chunk_size, MPI_INT, global_array, chunk_size, MPI_INT, 0, MPI_COMM_WORLD);
+        kernel.name = "gather_parallel_merge_sort";
+        kernel.threads = benchmark.merge_threads = threads;
+        bench_run(&bench, &kernel, &result);
 
-        if (rank == 0) {
-            merge_sorted_sections(global_array, size, chunk_size, ARRAY_SIZE);
-            total_time += MPI_Wtime() - start_time;
-        }
-    }
+        kernel.name = "sample_sort";
+        kernel.run = run_sample_sort;
+        bench_run(&bench, &kernel, &result);
 
-    if (rank == 0) {
-        total_time /= ITERATIONS;
-        fprintf(result_file, "%d\t%.7f\n", size, total_time);
-        fclose(result_file);
-        free(global_array);
+        kernel.name = "sample_sort_gathered";
+        benchmark.gather_result = 1;
+        bench_run(&bench, &kernel, &result);
+        benchmark.gather_result = 0;
+
+        kernel.setup = generate_input;
+        kernel.name = "blocking_merge_sort";
+        kernel.run = run_blocking_merge_sort;
+        benchmark.sort_seconds = benchmark.merge_seconds = 0.0;
+        benchmark.timed_runs = 0;
+        bench_run(&bench, &kernel, &result);
+        double blocking = result.median;
+
+        kernel.name = "pipelined_merge_sort";
+        kernel.run = run_pipelined_merge_sort;
+        bench_run(&bench, &kernel, &result);
+        report_overlap(&benchmark, blocking, result.median);
+
+        if (ranks == size)
+            break;
     }
+    bench_finish(&bench);
 
-    free(local_array);
+    if (benchmark.comm != MPI_COMM_NULL)
+        MPI_Comm_free(&benchmark.comm);
+    free(benchmark.global_array);
+    free(benchmark.merge_buffer);
+    free(benchmark.counts);
+    free(benchmark.displacements);
+    free(benchmark.local_array);
+    free(benchmark.local_buffer);
+    free(benchmark.stage_counts);
+    free(benchmark.requests);
+    free(benchmark.samples);
+    free(benchmark.splitters);
+    free(benchmark.send_counts);
+    free(benchmark.received);
+    free(benchmark.sorted);
     MPI_Finalize();
     return 0;
 }
@@ -1,38 +1,203 @@
+#define _GNU_SOURCE
 #include <mpi.h>
 #include <omp.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "../common/bench.h"
+#include "../common/tuning_profile.h"
+#include "../common/placement.h"
 
-int is_prime_number(int num) {
-    for (int i = 2; i <= (int)sqrt(num); i++) {
-        if (num % i == 0) {
-            return 0;
+#define SIEVE_SEGMENT_BYTES (32 * 1024)
+#define SIEVE_SEGMENT_BITS (SIEVE_SEGMENT_BYTES * 8)
+#define SIEVE_SEGMENT_SPAN (2LL * SIEVE_SEGMENT_BITS)
+#define PRIME_STREAM_BLOCK (1 << 18)
+#define CACHE_LINE 64
+
+/*
+ * Segmented sieve of Eratosthenes over [start, end). Segments cover
+ * SIEVE_SEGMENT_SPAN numbers each and keep one bit per odd number, so a
+ * segment is an L1-sized bitset that is sieved by the odd base primes up to
+ * sqrt(end) independently of every other segment.
+ */
+typedef struct {
+    long long start;
+    long long end;
+    long long segments;
+    int* base_primes;       ///< Odd primes up to sqrt(end)
+    int base_count;
+} prime_sieve;
+
+void prime_sieve_init(prime_sieve* sieve, long long start, long long end) {
+    sieve->start = start;
+    sieve->end = end > start ? end : start;
+    sieve->segments = (sieve->end - start + SIEVE_SEGMENT_SPAN - 1) / SIEVE_SEGMENT_SPAN;
+
+    int limit = (int)sqrt((double)sieve->end) + 1;
+    while ((long long)limit * limit >= sieve->end && limit > 0)
+        limit--;
+    char* composite = (char*)calloc(limit + 1, 1);
+    sieve->base_primes = (int*)malloc((limit / 2 + 1) * sizeof(int));
+    sieve->base_count = 0;
+    for (int p = 3; p <= limit; p += 2) {
+        if (composite[p])
+            continue;
+        sieve->base_primes[sieve->base_count++] = p;
+        for (long long m = (long long)p * p; m <= limit; m += 2 * p)
+            composite[m] = 1;
+    }
+    free(composite);
+}
+
+void prime_sieve_free(prime_sieve* sieve) {
+    free(sieve->base_primes);
+}
+
+/*
+ * Sieve one segment into `bits`: bit i set means first + 2 * i is prime.
+ * Returns the number of bits in use; 2, the only even prime, is left to
+ * the caller.
+ */
+int prime_sieve_segment(const prime_sieve* sieve, long long index, uint64_t* bits, long long* first) {
+    long long low = sieve->start + index * SIEVE_SEGMENT_SPAN;
+    long long high = low + SIEVE_SEGMENT_SPAN < sieve->end ? low + SIEVE_SEGMENT_SPAN : sieve->end;
+    long long odd = low | 1;
+    int count = high > odd ? (int)((high - odd + 1) / 2) : 0;
+    *first = odd;
+
+    memset(bits, 0xFF, (count + 63) / 64 * sizeof(uint64_t));
+    if (count % 64)
+        bits[count / 64] &= (1ULL << (count % 64)) - 1;
+    if (odd == 1 && count > 0)
+        bits[0] &= ~1ULL;
+
+    for (int b = 0; b < sieve->base_count; b++) {
+        long long p = sieve->base_primes[b];
+        long long m = p * p;
+        if (m >= high)
+            break;
+        if (m < odd) {
+            m = (odd + p - 1) / p * p;
+            if (m % 2 == 0)
+                m += p;
         }
+        for (long long i = (m - odd) / 2; i < count; i += p)
+            bits[i / 64] &= ~(1ULL << (i % 64));
     }
-    return 1;
+    return count;
+}
+
+/* Primes one thread found, segment after segment, in the order it sieved them; one cache line per thread */
+typedef struct {
+    _Alignas(CACHE_LINE) int* primes;
+    long long count;
+    long long capacity;
+} prime_buffer;
+
+static inline void prime_buffer_reserve(prime_buffer* buffer, long long extra) {
+    if (buffer->count + extra <= buffer->capacity)
+        return;
+    long long capacity = buffer->capacity > 0 ? buffer->capacity : SIEVE_SEGMENT_BITS / 4;
+    while (capacity < buffer->count + extra)
+        capacity *= 2;
+    buffer->primes = (int*)realloc(buffer->primes, capacity * sizeof(int));
+    buffer->capacity = capacity;
 }
 
-int generate_prime_list(int* prime_array, int start_value, int end_value) {
-    int count = 0;
-#pragma omp parallel shared(start_value, end_value, prime_array, count) default(none)
+/*
+ * Every thread appends the primes of its segments to its own buffer and
+ * notes where each segment starts there. A prefix sum over the per
+ * segment counts then gives every segment its place in prime_array, and
+ * the segments are copied there in parallel: the list comes out sorted,
+ * whatever the schedule, without a lock. Nothing is written past
+ * `capacity`; -1 is returned when the primes would not fit.
+ */
+int generate_prime_list(int* prime_array, long long capacity, int start_value, int end_value) {
+    prime_sieve sieve;
+    prime_sieve_init(&sieve, start_value, end_value);
+    long long segments = sieve.segments;
+    int max_threads = omp_get_max_threads();
+    prime_buffer* buffers = (prime_buffer*)aligned_alloc(CACHE_LINE, max_threads * sizeof(prime_buffer));
+    int* owners = (int*)malloc((segments + 1) * sizeof(int));
+    long long* local_offsets = (long long*)malloc((segments + 1) * sizeof(long long));
+    long long* counts = (long long*)malloc((segments + 1) * sizeof(long long));
+    long long* offsets = (long long*)malloc((segments + 1) * sizeof(long long));
+    long long total = start_value <= 2 && end_value > 2;
+    memset(buffers, 0, max_threads * sizeof(prime_buffer));
+    if (total && capacity > 0)
+        prime_array[0] = 2;
+
+#pragma omp parallel shared(sieve, segments, buffers, owners, local_offsets, counts, offsets, total, prime_array, \
+                            capacity) default(none)
     {
-#pragma omp for
-        for (int i = start_value; i < end_value; i++) {
-            if (is_prime_number(i)) {
-#pragma omp critical
-                {
-                    prime_array[count] = i;
-                    count++;
-                }
+        int thread = omp_get_thread_num();
+        prime_buffer* buffer = &buffers[thread];
+        uint64_t* bits = (uint64_t*)malloc(SIEVE_SEGMENT_BYTES);
+#pragma omp for schedule(runtime)
+        for (long long segment = 0; segment < segments; segment++) {
+            long long first;
+            int bit_count = prime_sieve_segment(&sieve, segment, bits, &first);
+            owners[segment] = thread;
+            local_offsets[segment] = buffer->count;
+            for (int word = 0; word < (bit_count + 63) / 64; word++) {
+                uint64_t w = bits[word];
+                prime_buffer_reserve(buffer, 64);
+                for (; w != 0; w &= w - 1)
+                    buffer->primes[buffer->count++] = (int)(first + 2 * (64LL * word + __builtin_ctzll(w)));
             }
+            counts[segment] = buffer->count - local_offsets[segment];
+        }
+        free(bits);
+
+#pragma omp single
+        for (long long segment = 0; segment < segments; segment++) {
+            offsets[segment] = total;
+            total += counts[segment];
         }
+
+#pragma omp for schedule(static)
+        for (long long segment = 0; segment < segments; segment++)
+            if (total <= capacity)
+                memcpy(prime_array + offsets[segment], buffers[owners[segment]].primes + local_offsets[segment],
+                       counts[segment] * sizeof(int));
     }
-    return count;
+
+    for (int t = 0; t < max_threads; t++)
+        free(buffers[t].primes);
+    free(buffers);
+    free(owners);
+    free(local_offsets);
+    free(counts);
+    free(offsets);
+    prime_sieve_free(&sieve);
+    return total <= capacity ? (int)total : -1;
 }
 
-int estimate_prime_count(int range_value) {
-    return range_value / log(range_value);
+/*
+ * Dusart's bounds on pi(x), the number of primes up to x:
+ * x / ln x <= pi(x) for x >= 17, and pi(x) <= x / ln x * (1 + 1.2762 / ln x)
+ * for x > 1. Together they give an upper bound on the primes of any
+ * [start, end) that never overflows the list, without a counting pass.
+ */
+long long prime_count_upper(long long x) {
+    if (x < 2)
+        return 0;
+    double ln = log((double)x);
+    return (long long)((double)x / ln * (1.0 + 1.2762 / ln)) + 1;
+}
+
+long long prime_count_lower(long long x) {
+    if (x < 17)
+        return 0;
+    return (long long)((double)x / log((double)x));
+}
+
+long long prime_list_capacity(long long start, long long end) {
+    return end > start ? prime_count_upper(end - 1) - prime_count_lower(start - 1) : 0;
 }
 
 void initialize_mpi(int argc, char** argv, int* rank, int* num_processes, int* provided) {
@@ -53,62 +218,944 @@ void set_openmp_threads(int num_threads) {
     omp_set_num_threads(num_threads);
 }
 
+double max_over_ranks(double seconds) {
+    double global_seconds = seconds;
+    MPI_Allreduce(&seconds, &global_seconds, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+    return global_seconds;
+}
+
+void sum_over_ranks(uint64_t* values, int count) {
+    MPI_Allreduce(MPI_IN_PLACE, values, count, MPI_UINT64_T, MPI_SUM, MPI_COMM_WORLD);
+}
+
+/* How [0, range) is split over the ranks */
+typedef enum {
+    PARTITION_EQUAL,        ///< The same number of segments for every rank
+    PARTITION_COST,         ///< Contiguous runs of segments with the same estimated sieve cost
+    PARTITION_DYNAMIC,      ///< Ranks claim blocks of segments from a counter on rank 0 with MPI_Fetch_and_op
+    PARTITION_COUNT
+} partition_mode;
+
+const char* partition_mode_name(partition_mode mode) {
+    switch (mode) {
+        case PARTITION_EQUAL:
+            return "equal";
+        case PARTITION_COST:
+            return "cost";
+        case PARTITION_DYNAMIC:
+            return "dynamic";
+        default:
+            return "unknown";
+    }
+}
+
+/* Where the primes of every rank end up */
+typedef enum {
+    OUTPUT_GATHER,          ///< MPI_Gatherv of the whole list into one array on rank 0
+    OUTPUT_STREAM,          ///< Fixed-size pieces sent to rank 0, which writes them out one at a time
+    OUTPUT_FILES,           ///< Every rank writes its own list to <path>.<rank>.bin
+    OUTPUT_COUNT
+} output_mode;
+
+const char* output_mode_name(output_mode mode) {
+    switch (mode) {
+        case OUTPUT_GATHER:
+            return "gather";
+        case OUTPUT_STREAM:
+            return "stream";
+        case OUTPUT_FILES:
+            return "files";
+        default:
+            return "unknown";
+    }
+}
+
+typedef struct {
+    int rank;
+    int num_processes;
+    int range;
+    partition_mode partition;
+    output_mode output;
+    const char* output_path;    ///< File of the stream output (none: only checksummed), prefix of the per-rank files
+    int start_value;
+    int end_value;
+    int* prime_array;
+    long long capacity;         ///< Elements prime_array can hold
+    uint64_t checksum;          ///< XOR of the primes rank 0 streamed out
+    long long streamed;
+    int* sizes;
+    int* displacements;
+    double time_end;
+    int result_size;
+    /* Dynamic partition: the shared block counter and the blocks this rank claimed, in claim order */
+    MPI_Win window;
+    long long* counter;
+    long long block_span;
+    long long blocks;
+    int* block_ids;
+    int* block_counts;
+    int claimed;
+} prime_benchmark;
+
+/*
+ * Estimated cost of sieving [low, high): crossing off odd multiples of the
+ * base primes (about half the span times ln ln sqrt(high)), visiting every
+ * base prime once, and writing out roughly span / ln(high) primes.
+ */
+double segment_cost(long long low, long long high) {
+    double root = sqrt((double)high);
+    double span = (double)(high - low);
+    double marks = span / 2.0 * log(log(root > 3.0 ? root : 3.0));
+    double base = root / log(root > 3.0 ? root : 3.0);
+    double output = span / log(high > 3 ? (double)high : 3.0);
+    return marks + base + output + span / 128.0;
+}
+
+static inline double segment_cost_at(long long low, long long high, long long segment) {
+    long long first = low + segment * SIEVE_SEGMENT_SPAN;
+    return segment_cost(first, first + SIEVE_SEGMENT_SPAN < high ? first + SIEVE_SEGMENT_SPAN : high);
+}
+
+/* Cut the segments of [low, high) into num_processes contiguous runs of equal estimated cost */
+void partition_by_cost(long long low, long long high, int num_processes, int rank, long long* start, long long* end) {
+    long long segments = (high - low + SIEVE_SEGMENT_SPAN - 1) / SIEVE_SEGMENT_SPAN;
+    double total = 0.0;
+    for (long long s = 0; s < segments; s++)
+        total += segment_cost_at(low, high, s);
+
+    double before = 0.0;
+    long long first = 0;
+    *start = *end = low;
+    for (int r = 0; r <= rank; r++) {
+        double target = total * (r + 1) / num_processes;
+        long long last = first;
+        while (last < segments &&
+               (r == num_processes - 1 || before + segment_cost_at(low, high, last) / 2 < target)) {
+            before += segment_cost_at(low, high, last);
+            last++;
+        }
+        *start = low + first * SIEVE_SEGMENT_SPAN;
+        *end = low + last * SIEVE_SEGMENT_SPAN < high ? low + last * SIEVE_SEGMENT_SPAN : high;
+        first = last;
+    }
+}
+
+/* Gather the primes of every rank on rank 0 */
+void gather_primes(prime_benchmark* benchmark, int found_count) {
+    MPI_Gather(&found_count, 1, MPI_INT, benchmark->sizes, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if (!benchmark->rank) {
+        for (int i = 1; i < benchmark->num_processes; i++) {
+            benchmark->displacements[i] = benchmark->displacements[i - 1] + benchmark->sizes[i - 1];
+        }
+    }
+    MPI_Reduce(&found_count, &benchmark->result_size, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
+
+    int* result = (int*)calloc(benchmark->result_size + 1, sizeof(int));
+    MPI_Gatherv(benchmark->prime_array, found_count, MPI_INT, result, benchmark->sizes, benchmark->displacements,
+                MPI_INT, 0, MPI_COMM_WORLD);
+    free(result);
+}
+
+/* Write `count` primes at element `offset` of the output file, if there is one, and fold them into the checksum */
+void consume_primes(prime_benchmark* benchmark, int fd, const int* primes, int count, long long offset) {
+    if (fd >= 0 && pwrite(fd, primes, (size_t)count * sizeof(int), (off_t)offset * sizeof(int)) < 0)
+        perror("lab7: writing the prime stream");
+    for (int i = 0; i < count; i++)
+        benchmark->checksum ^= (uint64_t)primes[i];
+    benchmark->streamed += count;
+}
+
+/*
+ * Send the list to rank 0 in PRIME_STREAM_BLOCK pieces with MPI_Isend. An
+ * exclusive scan of the counts gives every rank its offset in the global
+ * list and the tag of a piece is its index within the rank, so rank 0
+ * puts every piece in its place as it arrives and never holds more than
+ * one piece besides its own list.
+ */
+void stream_primes(prime_benchmark* benchmark, int found_count) {
+    long long count = found_count;
+    long long offset = 0;
+    long long pieces = (count + PRIME_STREAM_BLOCK - 1) / PRIME_STREAM_BLOCK;
+    long long total_pieces = 0;
+    long long* offsets = !benchmark->rank ? (long long*)malloc(benchmark->num_processes * sizeof(long long)) : NULL;
+    MPI_Exscan(&count, &offset, 1, MPI_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+    if (!benchmark->rank)
+        offset = 0;
+    MPI_Reduce(&pieces, &total_pieces, 1, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Gather(&offset, 1, MPI_LONG_LONG, offsets, 1, MPI_LONG_LONG, 0, MPI_COMM_WORLD);
+
+    if (benchmark->rank) {
+        MPI_Request* requests = (MPI_Request*)malloc((pieces + 1) * sizeof(MPI_Request));
+        for (long long k = 0; k < pieces; k++) {
+            long long first = k * PRIME_STREAM_BLOCK;
+            int length = (int)(count - first < PRIME_STREAM_BLOCK ? count - first : PRIME_STREAM_BLOCK);
+            MPI_Isend(benchmark->prime_array + first, length, MPI_INT, 0, (int)k, MPI_COMM_WORLD, &requests[k]);
+        }
+        MPI_Waitall((int)pieces, requests, MPI_STATUSES_IGNORE);
+        free(requests);
+        return;
+    }
+
+    int fd = -1;
+    if (benchmark->output_path != NULL) {
+        fd = open(benchmark->output_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+            perror("lab7: opening the prime stream");
+    }
+    benchmark->checksum = 0;
+    benchmark->streamed = 0;
+    consume_primes(benchmark, fd, benchmark->prime_array, found_count, 0);
+
+    int* piece = (int*)malloc(PRIME_STREAM_BLOCK * sizeof(int));
+    for (long long received = pieces; received < total_pieces; received++) {
+        MPI_Status status;
+        int length;
+        MPI_Recv(piece, PRIME_STREAM_BLOCK, MPI_INT, MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
+        MPI_Get_count(&status, MPI_INT, &length);
+        consume_primes(benchmark, fd, piece, length,
+                       offsets[status.MPI_SOURCE] + (long long)status.MPI_TAG * PRIME_STREAM_BLOCK);
+    }
+    if (fd >= 0)
+        close(fd);
+    free(piece);
+    free(offsets);
+}
+
+/*
+ * Deliver the blocks of the dynamic partition. Rank 0 first collects who
+ * claimed which block and how many primes it holds, which fixes the offset
+ * of every block in the global list. The blocks then travel in
+ * PRIME_STREAM_BLOCK pieces tagged with the block id. Pieces of one block
+ * arrive in order, so rank 0 puts each one where the previous one ended:
+ * gather receives straight into the list, and stream writes every piece
+ * out as it arrives.
+ */
+void deliver_dynamic_blocks(prime_benchmark* benchmark) {
+    long long blocks = benchmark->blocks;
+    int* claims = NULL;
+    int* claim_displacements = NULL;
+    int* records = NULL;
+    if (!benchmark->rank) {
+        claims = (int*)malloc(benchmark->num_processes * sizeof(int));
+        claim_displacements = (int*)calloc(benchmark->num_processes, sizeof(int));
+        records = (int*)malloc(2 * blocks * sizeof(int));
+    }
+    MPI_Gather(&benchmark->claimed, 1, MPI_INT, claims, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if (!benchmark->rank) {
+        for (int i = 1; i < benchmark->num_processes; i++)
+            claim_displacements[i] = claim_displacements[i - 1] + claims[i - 1];
+    }
+    MPI_Gatherv(benchmark->block_ids, benchmark->claimed, MPI_INT, records, claims, claim_displacements, MPI_INT,
+                0, MPI_COMM_WORLD);
+    MPI_Gatherv(benchmark->block_counts, benchmark->claimed, MPI_INT, records ? records + blocks : NULL,
+                claims, claim_displacements, MPI_INT, 0, MPI_COMM_WORLD);
+
+    if (benchmark->rank) {
+        long long pieces = 0, position = 0;
+        for (int c = 0; c < benchmark->claimed; c++)
+            pieces += (benchmark->block_counts[c] + PRIME_STREAM_BLOCK - 1) / PRIME_STREAM_BLOCK;
+        MPI_Request* requests = (MPI_Request*)malloc((pieces + 1) * sizeof(MPI_Request));
+        pieces = 0;
+        for (int c = 0; c < benchmark->claimed; c++) {
+            int count = benchmark->block_counts[c];
+            for (int first = 0; first < count; first += PRIME_STREAM_BLOCK) {
+                int length = count - first < PRIME_STREAM_BLOCK ? count - first : PRIME_STREAM_BLOCK;
+                MPI_Isend(benchmark->prime_array + position + first, length, MPI_INT, 0, benchmark->block_ids[c],
+                          MPI_COMM_WORLD, &requests[pieces++]);
+            }
+            position += count;
+        }
+        MPI_Waitall((int)pieces, requests, MPI_STATUSES_IGNORE);
+        free(requests);
+        return;
+    }
+
+    /* Rank 0: owner, size and global offset of every block, and where rank 0's own blocks sit in its list */
+    int* owners = (int*)malloc(blocks * sizeof(int));
+    int* counts = (int*)malloc(blocks * sizeof(int));
+    long long* offsets = (long long*)malloc((blocks + 1) * sizeof(long long));
+    long long* received = (long long*)calloc(blocks, sizeof(long long));
+    for (int i = 0; i < benchmark->num_processes; i++)
+        for (int r = claim_displacements[i]; r < claim_displacements[i] + claims[i]; r++) {
+            owners[records[r]] = i;
+            counts[records[r]] = records[blocks + r];
+        }
+    offsets[0] = 0;
+    for (long long b = 0; b < blocks; b++)
+        offsets[b + 1] = offsets[b] + counts[b];
+    benchmark->result_size = (int)offsets[blocks];
+
+    long long remote_pieces = 0;
+    for (long long b = 0; b < blocks; b++)
+        if (owners[b] != 0)
+            remote_pieces += (counts[b] + PRIME_STREAM_BLOCK - 1) / PRIME_STREAM_BLOCK;
+
+    if (benchmark->output == OUTPUT_STREAM) {
+        int fd = -1;
+        if (benchmark->output_path != NULL) {
+            fd = open(benchmark->output_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (fd < 0)
+                perror("lab7: opening the prime stream");
+        }
+        benchmark->checksum = 0;
+        benchmark->streamed = 0;
+        long long position = 0;
+        for (int c = 0; c < benchmark->claimed; c++) {
+            consume_primes(benchmark, fd, benchmark->prime_array + position, benchmark->block_counts[c],
+                           offsets[benchmark->block_ids[c]]);
+            position += benchmark->block_counts[c];
+        }
+
+        int* piece = (int*)malloc(PRIME_STREAM_BLOCK * sizeof(int));
+        for (long long k = 0; k < remote_pieces; k++) {
+            MPI_Status status;
+            int length;
+            MPI_Recv(piece, PRIME_STREAM_BLOCK, MPI_INT, MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
+            MPI_Get_count(&status, MPI_INT, &length);
+            consume_primes(benchmark, fd, piece, length, offsets[status.MPI_TAG] + received[status.MPI_TAG]);
+            received[status.MPI_TAG] += length;
+        }
+        if (fd >= 0)
+            close(fd);
+        free(piece);
+    } else {
+        int* result = (int*)malloc((offsets[blocks] + 1) * sizeof(int));
+        MPI_Request* requests = (MPI_Request*)malloc((remote_pieces + 1) * sizeof(MPI_Request));
+        long long posted = 0, position = 0;
+        for (long long b = 0; b < blocks; b++)
+            for (int first = 0; owners[b] != 0 && first < counts[b]; first += PRIME_STREAM_BLOCK) {
+                int length = counts[b] - first < PRIME_STREAM_BLOCK ? counts[b] - first : PRIME_STREAM_BLOCK;
+                MPI_Irecv(result + offsets[b] + first, length, MPI_INT, owners[b], (int)b, MPI_COMM_WORLD,
+                          &requests[posted++]);
+            }
+        for (int c = 0; c < benchmark->claimed; c++) {
+            memcpy(result + offsets[benchmark->block_ids[c]], benchmark->prime_array + position,
+                   benchmark->block_counts[c] * sizeof(int));
+            position += benchmark->block_counts[c];
+        }
+        MPI_Waitall((int)posted, requests, MPI_STATUSES_IGNORE);
+        free(requests);
+        free(result);
+    }
+
+    free(owners);
+    free(counts);
+    free(offsets);
+    free(received);
+    free(claims);
+    free(claim_displacements);
+    free(records);
+}
+
+void write_rank_file(prime_benchmark* benchmark, int found_count) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s.%d.bin", benchmark->output_path, benchmark->rank);
+    FILE* file = fopen(path, "wb");
+    if (file == NULL || fwrite(benchmark->prime_array, sizeof(int), found_count, file) != (size_t)found_count)
+        fprintf(stderr, "lab7: cannot write %s\n", path);
+    if (file != NULL)
+        fclose(file);
+}
+
+void deliver_primes(prime_benchmark* benchmark, int found_count) {
+    switch (benchmark->output) {
+        case OUTPUT_STREAM:
+            stream_primes(benchmark, found_count);
+            break;
+        case OUTPUT_FILES:
+            write_rank_file(benchmark, found_count);
+            break;
+        case OUTPUT_GATHER:
+        default:
+            gather_primes(benchmark, found_count);
+            break;
+    }
+}
+
+void check_found(const prime_benchmark* benchmark, int found_count) {
+    if (found_count < 0) {
+        fprintf(stderr, "rank %d: more primes than the %lld the list was sized for\n", benchmark->rank,
+                benchmark->capacity);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+}
+
+void run_prime_search(void* ctx) {
+    prime_benchmark* benchmark = (prime_benchmark*) ctx;
+    double time_start = MPI_Wtime();
+    int found_count = generate_prime_list(benchmark->prime_array, benchmark->capacity, benchmark->start_value,
+                                          benchmark->end_value);
+    benchmark->time_end = MPI_Wtime() - time_start;
+    check_found(benchmark, found_count);
+    MPI_Barrier(MPI_COMM_WORLD);
+    deliver_primes(benchmark, found_count);
+}
+
+void reset_block_counter(void* ctx) {
+    prime_benchmark* benchmark = (prime_benchmark*) ctx;
+    if (!benchmark->rank) {
+        MPI_Win_lock(MPI_LOCK_EXCLUSIVE, 0, 0, benchmark->window);
+        *benchmark->counter = 0;
+        MPI_Win_unlock(0, benchmark->window);
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+}
+
+/* Claim blocks until the counter runs past the last one; rank 0 hosts the counter and sieves as well */
+void run_prime_search_dynamic(void* ctx) {
+    prime_benchmark* benchmark = (prime_benchmark*) ctx;
+    const long long one = 1;
+    long long block = 0;
+    int found_count = 0;
+    benchmark->claimed = 0;
+
+    double time_start = MPI_Wtime();
+    MPI_Win_lock_all(0, benchmark->window);
+    for (;;) {
+        MPI_Fetch_and_op(&one, &block, MPI_LONG_LONG, 0, 0, MPI_SUM, benchmark->window);
+        MPI_Win_flush(0, benchmark->window);
+        if (block >= benchmark->blocks)
+            break;
+
+        long long low = block * benchmark->block_span;
+        long long high = low + benchmark->block_span < benchmark->range ? low + benchmark->block_span : benchmark->range;
+        long long needed = found_count + prime_list_capacity(low, high);
+        if (needed > benchmark->capacity) {
+            benchmark->capacity = needed > 2 * benchmark->capacity ? needed : 2 * benchmark->capacity;
+            benchmark->prime_array = (int*)realloc(benchmark->prime_array, benchmark->capacity * sizeof(int));
+        }
+        int found = generate_prime_list(benchmark->prime_array + found_count, benchmark->capacity - found_count,
+                                        (int)low, (int)high);
+        check_found(benchmark, found);
+        benchmark->block_ids[benchmark->claimed] = (int)block;
+        benchmark->block_counts[benchmark->claimed] = found;
+        benchmark->claimed++;
+        found_count += found;
+    }
+    MPI_Win_unlock_all(benchmark->window);
+    benchmark->time_end = MPI_Wtime() - time_start;
+    MPI_Barrier(MPI_COMM_WORLD);
+    deliver_dynamic_blocks(benchmark);
+}
+
+/*
+ * Split [0, range) over the ranks by `partition` and allocate the buffers
+ * of the prime searches. A static part gets a list sized by its Dusart upper
+ * bound, which never overflows; under the dynamic partition the list grows
+ * with the claimed blocks.
+ */
+void prime_benchmark_init(prime_benchmark* benchmark, int rank, int num_processes, int range,
+                          partition_mode partition) {
+    long long segments = (range + SIEVE_SEGMENT_SPAN - 1) / SIEVE_SEGMENT_SPAN;
+    long long start = segments * rank / num_processes * SIEVE_SEGMENT_SPAN;
+    long long end = segments * (rank + 1) / num_processes * SIEVE_SEGMENT_SPAN;
+    if (partition == PARTITION_COST)
+        partition_by_cost(0, range, num_processes, rank, &start, &end);
+    if (partition == PARTITION_DYNAMIC) {
+        start = 0;
+        end = range;
+    }
+
+    memset(benchmark, 0, sizeof(*benchmark));
+    benchmark->rank = rank;
+    benchmark->num_processes = num_processes;
+    benchmark->range = range;
+    benchmark->partition = partition;
+    benchmark->start_value = (int)(start < range ? start : range);
+    benchmark->end_value = (int)(end < range ? end : range);
+
+    if (partition != PARTITION_DYNAMIC) {
+        benchmark->capacity = prime_list_capacity(benchmark->start_value, benchmark->end_value);
+        benchmark->prime_array = (int*) malloc((benchmark->capacity + 1) * sizeof(int));
+    }
+    if (!rank) {
+        benchmark->sizes = (int*) malloc(num_processes * sizeof(int));
+        benchmark->displacements = (int*)calloc(num_processes, sizeof(int));
+    }
+
+    if (partition == PARTITION_DYNAMIC) {
+        /* Enough segments per block to keep every thread of the rank busy */
+        benchmark->block_span = 2LL * omp_get_max_threads() * SIEVE_SEGMENT_SPAN;
+        benchmark->blocks = (range + benchmark->block_span - 1) / benchmark->block_span;
+        benchmark->block_ids = (int*)malloc((benchmark->blocks + 1) * sizeof(int));
+        benchmark->block_counts = (int*)malloc((benchmark->blocks + 1) * sizeof(int));
+        MPI_Win_allocate(rank == 0 ? sizeof(long long) : 0, sizeof(long long), MPI_INFO_NULL, MPI_COMM_WORLD,
+                         &benchmark->counter, &benchmark->window);
+    }
+}
+
+void prime_benchmark_free(prime_benchmark* benchmark) {
+    if (benchmark->partition == PARTITION_DYNAMIC) {
+        MPI_Win_free(&benchmark->window);
+        free(benchmark->block_ids);
+        free(benchmark->block_counts);
+    }
+    free(benchmark->prime_array);
+    free(benchmark->sizes);
+    free(benchmark->displacements);
+}
+
+/* Tune the loop schedule on a smaller range; every rank takes part, rank 0 stores the profile */
+void autotune(bench_config* bench, int rank, int num_processes, int num_threads, int range) {
+    prime_benchmark benchmark;
+    prime_benchmark_init(&benchmark, rank, num_processes, range, PARTITION_EQUAL);
+    bench_kernel kernel = {"lab7/prime_list", NULL, range, num_threads, num_processes, 0.0,
+                           NULL, run_prime_search, &benchmark};
+    tuning_entry best;
+    tuning_search(bench, &kernel, (range / num_processes + SIEVE_SEGMENT_SPAN - 1) / SIEVE_SEGMENT_SPAN, NULL, 0,
+                  &best);
+    if (!rank)
+        tuning_profile_store(&best, 1);
+    prime_benchmark_free(&benchmark);
+}
+
+/*
+ * Threads for this rank: OMP_NUM_THREADS when set, otherwise the cores the
+ * rank may run on. A rank that is not bound sees every core of the node,
+ * and then shares them with the other ranks on the node.
+ */
+int rank_threads(void) {
+    if (getenv("OMP_NUM_THREADS") != NULL)
+        return omp_get_max_threads();
+
+    MPI_Comm node;
+    int node_ranks;
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &node);
+    MPI_Comm_size(node, &node_ranks);
+    MPI_Comm_free(&node);
+
+    int cores = omp_get_num_procs();
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    if (online > 0 && cores >= online)
+        cores /= node_ranks;
+    return cores > 0 ? cores : 1;
+}
+
+/* Questions about the primes of an interval that need no list of them */
+typedef enum {
+    QUERY_COUNT,            ///< pi: primes below the limit
+    QUERY_SUM,              ///< Sum of the primes below the limit
+    QUERY_XOR,              ///< XOR checksum of the primes below the limit
+    QUERY_KTH,              ///< The k-th prime
+    QUERY_RANGE,            ///< Number of primes in [from, to)
+    QUERY_COUNT_MODES
+} query_mode;
+
+const char* query_mode_name(query_mode mode) {
+    switch (mode) {
+        case QUERY_COUNT:
+            return "count";
+        case QUERY_SUM:
+            return "sum";
+        case QUERY_XOR:
+            return "xor";
+        case QUERY_KTH:
+            return "kth";
+        case QUERY_RANGE:
+            return "range";
+        default:
+            return "unknown";
+    }
+}
+
+/* The sum of the primes below n passes 2^64 at n of about 1e11; 128 bits last beyond 1e19 */
+typedef unsigned __int128 uint128;
+
+typedef struct {
+    uint64_t count;
+    uint128 sum;
+    uint64_t checksum;
+} prime_totals;
+
+/* MPI_SUM for uint128 values, which travel as a pair of MPI_UINT64_T */
+void sum_uint128(void* in, void* inout, int* len, MPI_Datatype* type) {
+    const uint128* a = (const uint128*)in;
+    uint128* b = (uint128*)inout;
+    for (int i = 0; i < *len; i++)
+        b[i] += a[i];
+    (void)type;
+}
+
+/* Decimal digits of value into text, which must hold 40 characters */
+const char* format_uint128(uint128 value, char* text) {
+    char digits[40];
+    int length = 0;
+    do {
+        digits[length++] = (char)('0' + (int)(value % 10));
+        value /= 10;
+    } while (value != 0);
+    for (int i = 0; i < length; i++)
+        text[i] = digits[length - 1 - i];
+    text[length] = '\0';
+    return text;
+}
+
+/*
+ * Fold the primes of [start, end) into per-thread totals: counts come from
+ * popcounts of the segment bitsets, and the primes themselves are only
+ * visited when `values` asks for their sum and XOR. `segment_counts`, when
+ * given, receives the count of every segment (without the prime 2).
+ */
+prime_totals accumulate_primes(long long start, long long end, int values, uint64_t* segment_counts) {
+    prime_sieve sieve;
+    prime_sieve_init(&sieve, start, end);
+    uint64_t count = 0, checksum = 0;
+    uint128 sum = 0;
+    if (start <= 2 && end > 2) {
+        count = 1;
+        sum = checksum = 2;
+    }
+
+#pragma omp parallel shared(sieve, values, segment_counts) reduction(+: count, sum) reduction(^: checksum) default(none)
+    {
+        uint64_t* bits = (uint64_t*)malloc(SIEVE_SEGMENT_BYTES);
+#pragma omp for schedule(runtime)
+        for (long long segment = 0; segment < sieve.segments; segment++) {
+            long long first;
+            int bit_count = prime_sieve_segment(&sieve, segment, bits, &first);
+            uint64_t found = 0;
+            for (int word = 0; word < (bit_count + 63) / 64; word++) {
+                uint64_t w = bits[word];
+                found += __builtin_popcountll(w);
+                for (; values && w != 0; w &= w - 1) {
+                    uint64_t prime = (uint64_t)(first + 2 * (64LL * word + __builtin_ctzll(w)));
+                    sum += prime;
+                    checksum ^= prime;
+                }
+            }
+            if (segment_counts != NULL)
+                segment_counts[segment] = found;
+            count += found;
+        }
+        free(bits);
+    }
+    prime_sieve_free(&sieve);
+    return (prime_totals){count, sum, checksum};
+}
+
+/* The `index`-th prime (1-based) of [start, end), given the per segment counts of accumulate_primes */
+long long select_prime(long long start, long long end, const uint64_t* segment_counts, long long index) {
+    if (start <= 2 && end > 2 && index-- == 1)
+        return 2;
+    prime_sieve sieve;
+    prime_sieve_init(&sieve, start, end);
+    long long segment = 0;
+    while (segment < sieve.segments && index > (long long)segment_counts[segment])
+        index -= segment_counts[segment++];
+
+    long long prime = 0;
+    if (segment < sieve.segments) {
+        uint64_t* bits = (uint64_t*)malloc(SIEVE_SEGMENT_BYTES);
+        long long first;
+        int bit_count = prime_sieve_segment(&sieve, segment, bits, &first);
+        for (int word = 0; word < (bit_count + 63) / 64 && prime == 0; word++) {
+            for (uint64_t w = bits[word]; w != 0; w &= w - 1)
+                if (--index == 0) {
+                    prime = first + 2 * (64LL * word + __builtin_ctzll(w));
+                    break;
+                }
+        }
+        free(bits);
+    }
+    prime_sieve_free(&sieve);
+    return prime;
+}
+
+/* Upper bound on the k-th prime: k (ln k + ln ln k) for k >= 6 */
+long long kth_prime_bound(long long k) {
+    if (k < 6)
+        return 13;
+    double ln = log((double)k);
+    return (long long)((double)k * (ln + log(ln))) + 1;
+}
+
+/*
+ * pi(n) by Lucy_Hedgehog's method in O(n^(3/4)) time and O(sqrt(n))
+ * memory: S(v) counts the numbers in [2, v] that survive sieving by the
+ * primes below p, for the O(sqrt(n)) values v = n / i only, and every prime
+ * p updates S(v) -= S(v / p) - S(p - 1) for v >= p^2. The updates of one p
+ * read values the same p rewrites, so each pass computes into a scratch
+ * array first and the threads split the entries.
+ */
+long long lucy_prime_count(long long n) {
+    if (n < 2)
+        return 0;
+    long long root = (long long)sqrt((double)n);
+    while (root * root > n)
+        root--;
+    while ((root + 1) * (root + 1) <= n)
+        root++;
+
+    long long* small = (long long*)malloc((root + 1) * sizeof(long long));     ///< S(v) for v <= root
+    long long* large = (long long*)malloc((root + 1) * sizeof(long long));     ///< S(n / i) for i <= root
+    long long* scratch = (long long*)malloc((root + 1) * sizeof(long long));
+    for (long long v = 0; v <= root; v++)
+        small[v] = v - 1;
+    for (long long i = 1; i <= root; i++)
+        large[i] = n / i - 1;
+
+    for (long long p = 2; p <= root; p++) {
+        if (small[p] == small[p - 1])
+            continue;
+        long long below = small[p - 1];
+        long long square = p * p;
+        long long large_count = n / square < root ? n / square : root;
+
+#pragma omp parallel if (large_count > 4096) shared(small, large, scratch, n, p, root, below, large_count) \
+    default(none)
+        {
+#pragma omp for schedule(static)
+            for (long long i = 1; i <= large_count; i++) {
+                long long d = i * p;
+                scratch[i] = large[i] - ((d <= root ? large[d] : small[n / d]) - below);
+            }
+#pragma omp for schedule(static)
+            for (long long i = 1; i <= large_count; i++)
+                large[i] = scratch[i];
+        }
+
+        if (square <= root) {
+#pragma omp parallel if (root - square > 4096) shared(small, scratch, p, root, below, square) default(none)
+            {
+#pragma omp for schedule(static)
+                for (long long v = square; v <= root; v++)
+                    scratch[v] = small[v] - (small[v / p] - below);
+#pragma omp for schedule(static)
+                for (long long v = square; v <= root; v++)
+                    small[v] = scratch[v];
+            }
+        }
+    }
+
+    long long count = large[1];
+    free(small);
+    free(large);
+    free(scratch);
+    return count;
+}
+
+typedef struct {
+    query_mode mode;
+    int lucy;               ///< Count with lucy_prime_count on rank 0 instead of sieving
+    int rank;
+    int num_processes;
+    long long low;          ///< Interval asked about
+    long long high;
+    long long k;
+    long long start;        ///< This rank's part of it
+    long long end;
+    uint64_t* segment_counts;
+    MPI_Datatype uint128_type;
+    MPI_Op uint128_sum;
+    uint128 answer;         ///< On rank 0
+    double time_end;
+} prime_query;
+
+/* Cost-partition the interval of the query; for the k-th prime that is [0, bound on p_k] */
+void prime_query_init(prime_query* query, query_mode mode, int lucy, int rank, int num_processes, long long low,
+                      long long high, long long k) {
+    memset(query, 0, sizeof(*query));
+    query->mode = mode;
+    query->lucy = lucy && mode == QUERY_COUNT;
+    query->rank = rank;
+    query->num_processes = num_processes;
+    query->low = mode == QUERY_RANGE ? low : 0;
+    query->high = mode == QUERY_KTH ? kth_prime_bound(k) + 1 : high;
+    query->k = k;
+    partition_by_cost(query->low, query->high, num_processes, rank, &query->start, &query->end);
+    if (mode == QUERY_KTH)
+        query->segment_counts =
+            (uint64_t*)calloc((query->end - query->start) / SIEVE_SEGMENT_SPAN + 1, sizeof(uint64_t));
+    MPI_Type_contiguous(2, MPI_UINT64_T, &query->uint128_type);
+    MPI_Type_commit(&query->uint128_type);
+    MPI_Op_create(sum_uint128, 1, &query->uint128_sum);
+}
+
+void prime_query_free(prime_query* query) {
+    MPI_Op_free(&query->uint128_sum);
+    MPI_Type_free(&query->uint128_type);
+    free(query->segment_counts);
+}
+
+/* Per-thread totals on every rank, then one MPI_Reduce to rank 0; the k-th prime adds an MPI_Exscan to find its rank */
+void run_prime_query(void* ctx) {
+    prime_query* query = (prime_query*) ctx;
+    double time_start = MPI_Wtime();
+    if (query->lucy) {
+        if (!query->rank)
+            query->answer = (uint128)lucy_prime_count(query->high - 1);
+        query->time_end = MPI_Wtime() - time_start;
+        MPI_Barrier(MPI_COMM_WORLD);
+        return;
+    }
+
+    int values = query->mode == QUERY_SUM || query->mode == QUERY_XOR;
+    prime_totals local = accumulate_primes(query->start, query->end, values, query->segment_counts);
+    uint64_t kth = 0;
+    if (query->mode == QUERY_KTH) {
+        uint64_t before = 0;
+        MPI_Exscan(&local.count, &before, 1, MPI_UINT64_T, MPI_SUM, MPI_COMM_WORLD);
+        if (!query->rank)
+            before = 0;
+        if ((uint64_t)query->k > before && (uint64_t)query->k <= before + local.count)
+            kth = (uint64_t)select_prime(query->start, query->end, query->segment_counts, query->k - before);
+    }
+    query->time_end = MPI_Wtime() - time_start;
+
+    uint64_t answer = 0;
+    switch (query->mode) {
+        case QUERY_SUM:
+            MPI_Reduce(&local.sum, &query->answer, 1, query->uint128_type, query->uint128_sum, 0, MPI_COMM_WORLD);
+            return;
+        case QUERY_XOR:
+            MPI_Reduce(&local.checksum, &answer, 1, MPI_UINT64_T, MPI_BXOR, 0, MPI_COMM_WORLD);
+            break;
+        case QUERY_KTH:
+            MPI_Reduce(&kth, &answer, 1, MPI_UINT64_T, MPI_MAX, 0, MPI_COMM_WORLD);
+            break;
+        case QUERY_COUNT:
+        case QUERY_RANGE:
+        default:
+            MPI_Reduce(&local.count, &answer, 1, MPI_UINT64_T, MPI_SUM, 0, MPI_COMM_WORLD);
+            break;
+    }
+    query->answer = answer;
+}
+
+/*
+ * Usage: lab7 [--autotune] [--partition=equal|cost|dynamic] [--output=gather|stream|files] [--output-path=<path>]
+ *             [--bind=<policy>] [--places=<places>]
+ *        lab7 --output=count|sum|xor [--limit=<n>] [--engine=sieve|lucy]
+ *        lab7 --output=kth --k=<k>
+ *        lab7 --output=range --from=<a> --to=<b>
+ * Cost partition and gather output by default. The second group answers
+ * about the primes below the limit (1e8 by default) without listing them;
+ * the Lucy engine only counts.
+ */
 int main(int argc, char** argv) {
+    placement_configure(&argc, argv);
     int range = 100000000;
+    const int tuning_range = range / 100;
 
     int rank = 0;
     int num_processes = 0;
     int provided;
     initialize_mpi(argc, argv, &rank, &num_processes, &provided);
 
-    int num_threads = 16 / num_processes;
+    int tune = 0;
+    partition_mode partition = PARTITION_COST;
+    output_mode output = OUTPUT_GATHER;
+    const char* output_path = NULL;
+    int query_output = -1;
+    int lucy = 0;
+    long long limit = range, k = 1, from = 0, to = range;
+    for (int a = 1; a < argc; a++) {
+        tune |= strcmp(argv[a], "--autotune") == 0;
+        for (int m = 0; m < PARTITION_COUNT; m++)
+            if (strncmp(argv[a], "--partition=", 12) == 0 && strcmp(argv[a] + 12, partition_mode_name(m)) == 0)
+                partition = (partition_mode)m;
+        for (int m = 0; m < OUTPUT_COUNT; m++)
+            if (strncmp(argv[a], "--output=", 9) == 0 && strcmp(argv[a] + 9, output_mode_name(m)) == 0)
+                output = (output_mode)m;
+        for (int m = 0; m < QUERY_COUNT_MODES; m++)
+            if (strncmp(argv[a], "--output=", 9) == 0 && strcmp(argv[a] + 9, query_mode_name(m)) == 0)
+                query_output = m;
+        if (strncmp(argv[a], "--output-path=", 14) == 0)
+            output_path = argv[a] + 14;
+        lucy |= strcmp(argv[a], "--engine=lucy") == 0;
+        if (strncmp(argv[a], "--limit=", 8) == 0)
+            limit = (long long)strtod(argv[a] + 8, NULL);
+        if (strncmp(argv[a], "--k=", 4) == 0)
+            k = (long long)strtod(argv[a] + 4, NULL);
+        if (strncmp(argv[a], "--from=", 7) == 0)
+            from = (long long)strtod(argv[a] + 7, NULL);
+        if (strncmp(argv[a], "--to=", 5) == 0)
+            to = (long long)strtod(argv[a] + 5, NULL);
+    }
+    if (output == OUTPUT_FILES && output_path == NULL)
+        output_path = "primes";
+    /* Per-rank files only concatenate to the sorted list when every rank owns one contiguous range */
+    if (partition == PARTITION_DYNAMIC && output == OUTPUT_FILES) {
+        if (!rank)
+            fprintf(stderr, "lab7: --partition=dynamic cannot be combined with --output=files\n");
+        finalize_mpi();
+        return 1;
+    }
+
+    int num_threads = rank_threads();
     set_openmp_threads(num_threads);
     if (!rank) {
-        printf("Processors: %d, threads: %d\n", num_processes, num_threads);
+        printf("Processors: %d, threads: %d, partition: %s, output: %s\n", num_processes, num_threads,
+               partition_mode_name(partition), output_mode_name(output));
+        placement_report();
     }
     MPI_Barrier(MPI_COMM_WORLD);
 
-    int local_range = range / num_processes;
+    bench_config bench;
+    bench_config_default(&bench);
+    bench.warmup = 0;
+    bench.min_repetitions = 1;
+    bench.max_repetitions = 3;
+    bench.report = !rank;
+    bench.sync_sample = max_over_ranks;
+    bench.sync_counters = sum_over_ranks;
+    bench_config_env(&bench);
 
-    int start_value = local_range * rank;
-    int end_value = local_range * (rank + 1);
-    double time_start, time_end;
-    int array_size = 2 * (estimate_prime_count(end_value) - estimate_prime_count(start_value));
-    int* prime_array = (int*) calloc(array_size, sizeof(int));
-    int* sizes = NULL;
-    int* displacements = NULL;
-    if (!rank) {
-        sizes = (int*) malloc(num_processes * sizeof(int));
-        displacements = (int*)calloc(num_processes, sizeof(int));
+    if (query_output >= 0) {
+        static const char* kernel_names[] = {"prime_count", "prime_sum", "prime_xor", "prime_kth",
+                                             "prime_range_count"};
+        prime_query query;
+        prime_query_init(&query, (query_mode)query_output, lucy, rank, num_processes, from,
+                         query_output == QUERY_RANGE ? to : limit, k < 1 ? 1 : k);
+        tuning_apply("lab7/prime_list", tuning_range, num_threads);
+        bench_kernel kernel = {query.lucy ? "prime_count_lucy" : kernel_names[query_output], NULL,
+                               query.high - query.low, num_threads, num_processes, 0.0,
+                               NULL, run_prime_query, &query};
+        bench_result result;
+        bench_run(&bench, &kernel, &result);
+        bench_finish(&bench);
+        char answer[40];
+        format_uint128(query.answer, answer);
+        if (!rank && query.mode == QUERY_KTH)
+            printf("prime %lld: %s\n", query.k, answer);
+        else if (!rank)
+            printf("%s [%lld, %lld): %s\n", query_mode_name(query.mode), query.low, query.high, answer);
+        printf("%d - %lf \n", rank, query.time_end);
+        prime_query_free(&query);
+        finalize_mpi();
+        return 0;
     }
-    time_start = MPI_Wtime();
-    int found_count = generate_prime_list(prime_array, start_value, end_value);
-    time_end = MPI_Wtime() - time_start;
-    MPI_Barrier(MPI_COMM_WORLD);
-    MPI_Gather(&found_count, 1, MPI_INT, sizes, 1, MPI_INT, 0, MPI_COMM_WORLD);
-    if (!rank) {
-        for (int i = 1; i < num_processes; i++) {
-            displacements[i] = displacements[i - 1] + sizes[i - 1];
-        }
-    }
-    int result_size = 0;
-    MPI_Reduce(&found_count, &result_size, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
-
-    int* result = (int*)calloc(result_size, sizeof(int));
-    MPI_Gatherv(prime_array, found_count, MPI_INT, result, sizes, displacements, MPI_INT, 0, MPI_COMM_WORLD);
 
-    double total_time = MPI_Wtime() - time_start;
+    if (tune)
+        autotune(&bench, rank, num_processes, num_threads, tuning_range);
+    else if (tuning_apply("lab7/prime_list", tuning_range, num_threads) && !rank)
+        printf("schedule: tuned profile %s\n", tuning_profile_path());
 
-    if (!rank) {
-        printf("Total time = %lf\n", total_time);
+    prime_benchmark benchmark;
+    prime_benchmark_init(&benchmark, rank, num_processes, range, partition);
+    benchmark.output = output;
+    benchmark.output_path = output_path;
+    bench_kernel kernel = {"prime_list", NULL, range, num_threads, num_processes, 0.0,
+                           NULL, run_prime_search, &benchmark};
+    if (partition == PARTITION_DYNAMIC) {
+        kernel.setup = reset_block_counter;
+        kernel.run = run_prime_search_dynamic;
     }
+    bench_result result;
+    bench_run(&bench, &kernel, &result);
+    bench_finish(&bench);
+    if (output == OUTPUT_STREAM && !rank)
+        printf("streamed %lld primes%s%s, xor %llx\n", benchmark.streamed, output_path ? " to " : "",
+               output_path ? output_path : "", (unsigned long long)benchmark.checksum);
 
     double total_execution_time = 0;
-    MPI_Reduce(&time_end, &total_execution_time, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&benchmark.time_end, &total_execution_time, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
 
-    printf("%d - %lf ", rank, time_end);
+    printf("%d - %lf ", rank, benchmark.time_end);
     printf("\n");
+
+    prime_benchmark_free(&benchmark);
     finalize_mpi();
 
     return 0;
-}
\ No newline at end of file
+}